@@ -0,0 +1,150 @@
+#include <stddef.h>
+
+#include "accounting.h"
+
+/****** MEMORY ACCOUNTING ******/
+/*
+ * The containers of the big data structures use tracked_allocator, and
+ * the AST nodes, which are allocated with malloc, are accounted where
+ * they are allocated and freed. Everything else that is allocated with
+ * new, such as strings and the working sets of the passes, is accounted
+ * as other by replacing the global operator new and delete.
+ */
+
+memory_usage memory_usages[NUM_SUBSYSTEMS];
+memory_usage memory_total;
+long memory_window_peak;
+
+static const char *subsystem_names[NUM_SUBSYSTEMS] = {
+  "AST nodes",
+  "AST lists",
+  "symbol tables",
+  "register maps",
+  "IR",
+  "other",
+};
+
+static const char *subsystem_keys[NUM_SUBSYSTEMS] = {
+  "ast_nodes",
+  "ast_lists",
+  "symbol_tables",
+  "register_maps",
+  "ir",
+  "other",
+};
+
+static void add_bytes(memory_usage &usage, long bytes) {
+  usage.bytes += bytes;
+  if (usage.bytes > usage.peak) {
+    usage.peak = usage.bytes;
+  }
+}
+
+static void reset_usage(memory_usage &usage) {
+  usage.peak = usage.bytes;
+  usage.allocations = 0;
+}
+
+void reset_memory(void) {
+  for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+    reset_usage(memory_usages[s]);
+  }
+  reset_usage(memory_total);
+  memory_window_peak = memory_total.bytes;
+}
+
+void memory_allocated(memory_subsystem subsystem, size_t bytes) {
+  add_bytes(memory_usages[subsystem], bytes);
+  add_bytes(memory_total, bytes);
+  memory_usages[subsystem].allocations++;
+  memory_total.allocations++;
+  if (memory_total.bytes > memory_window_peak) {
+    memory_window_peak = memory_total.bytes;
+  }
+}
+
+void memory_freed(memory_subsystem subsystem, size_t bytes) {
+  memory_usages[subsystem].bytes -= bytes;
+  memory_total.bytes -= bytes;
+}
+
+void print_memory(FILE *f) {
+  fprintf(f, "%-14s %10s %10s %12s\n", "memory", "bytes", "peak", "allocations");
+  for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+    const memory_usage &usage = memory_usages[s];
+    fprintf(f, "%-14s %10ld %10ld %12ld\n", subsystem_names[s], usage.bytes, usage.peak, usage.allocations);
+  }
+  fprintf(f, "%-14s %10ld %10ld %12ld\n", "total", memory_total.bytes, memory_total.peak, memory_total.allocations);
+}
+
+void print_memory_json(FILE *f) {
+  fprintf(f, "{");
+  for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+    const memory_usage &usage = memory_usages[s];
+    fprintf(f, "\"%s\": {\"bytes\": %ld, \"peak\": %ld, \"allocations\": %ld}, ",
+            subsystem_keys[s], usage.bytes, usage.peak, usage.allocations);
+  }
+  fprintf(f, "\"total\": {\"bytes\": %ld, \"peak\": %ld, \"allocations\": %ld}}",
+          memory_total.bytes, memory_total.peak, memory_total.allocations);
+}
+
+// The size of a block is kept in front of it, in as many bytes as the
+// alignment that new has to guarantee
+static const size_t HEADER_SIZE = alignof(max_align_t);
+
+void *operator new(size_t size) {
+  char *block = (char *) malloc(size + HEADER_SIZE);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  *(size_t *) block = size;
+  memory_allocated(MEMORY_OTHER, size);
+  return block + HEADER_SIZE;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == NULL) {
+    return;
+  }
+  char *block = (char *) p - HEADER_SIZE;
+  memory_freed(MEMORY_OTHER, *(size_t *) block);
+  free(block);
+}
+
+// The other forms of new and delete have to be replaced as well, since
+// they don't necessarily call the ones above
+void *operator new[](size_t size) {
+  return ::operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return ::operator new(size);
+  } catch (const std::bad_alloc &) {
+    return NULL;
+  }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return ::operator new(size, std::nothrow);
+}
+
+void operator delete[](void *p) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  ::operator delete(p);
+}
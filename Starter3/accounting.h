@@ -0,0 +1,86 @@
+#ifndef _ACCOUNTING_H
+#define _ACCOUNTING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+// The parts of the compiler whose memory is accounted separately
+typedef enum {
+  MEMORY_AST,       // AST nodes and identifier names
+  MEMORY_AST_LISTS, // The declaration and statement lists of scopes
+  MEMORY_SYMBOLS,   // The symbol tables
+  MEMORY_REGISTERS, // The maps from variables and expressions to registers
+  MEMORY_IR,        // The registers and instructions of programs
+  MEMORY_OTHER,     // Everything else that is allocated with new
+  NUM_SUBSYSTEMS
+} memory_subsystem;
+
+typedef struct {
+  long bytes;
+  long peak;
+  long allocations;
+} memory_usage;
+
+extern memory_usage memory_usages[NUM_SUBSYSTEMS];
+
+// The usage of all subsystems together. Its peak is the most memory in
+// use at once, which can be less than the sum of the peaks
+extern memory_usage memory_total;
+
+// The peak of the total since it was last reset, for measuring phases
+extern long memory_window_peak;
+
+// Start accounting a new compilation. The memory that is still in use
+// stays accounted, but the peaks start from it and the allocations from 0
+void reset_memory(void);
+
+void memory_allocated(memory_subsystem subsystem, size_t bytes);
+void memory_freed(memory_subsystem subsystem, size_t bytes);
+
+// Print the usage of every subsystem
+void print_memory(FILE *f);
+void print_memory_json(FILE *f);
+
+// An allocator for standard containers that accounts the memory to a
+// subsystem
+template <typename T, memory_subsystem S>
+struct tracked_allocator {
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef tracked_allocator<U, S> other;
+  };
+
+  tracked_allocator() {}
+
+  template <typename U>
+  tracked_allocator(const tracked_allocator<U, S> &) {}
+
+  T *allocate(size_t n) {
+    void *p = malloc(n * sizeof(T));
+    if (p == NULL) {
+      throw std::bad_alloc();
+    }
+    memory_allocated(S, n * sizeof(T));
+    return (T *) p;
+  }
+
+  void deallocate(T *p, size_t n) {
+    memory_freed(S, n * sizeof(T));
+    free(p);
+  }
+};
+
+template <typename T, typename U, memory_subsystem S>
+bool operator==(const tracked_allocator<T, S> &, const tracked_allocator<U, S> &) {
+  return true;
+}
+
+template <typename T, typename U, memory_subsystem S>
+bool operator!=(const tracked_allocator<T, S> &, const tracked_allocator<U, S> &) {
+  return false;
+}
+
+#endif
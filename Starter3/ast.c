@@ -7,6 +7,8 @@
 #include "symbol.h"
 #include "semantic.h"
 #include "common.h"
+#include "timing.h"
+#include "probes.h"
 #include "parser.tab.h"
 
 #define DEBUG_PRINT_TREE 0
@@ -29,9 +31,14 @@ node *ast_allocate(node_kind kind, ...) {
 
   // make the node
   node *n = (node *) malloc(sizeof(node));
+  memory_allocated(MEMORY_AST, sizeof(node));
   memset(n, 0, sizeof *n);
   n->kind = kind;
   n->parent = NULL;
+  counters.nodes++;
+  if (counters.nodes % AST_PROBE_BATCH == 0) {
+    PROBE2(ast__alloc, counters.nodes, memory_usages[MEMORY_AST].bytes);
+  }
 
   n->line = yyline;
   n->column = yycolumn - 1;
@@ -56,7 +63,7 @@ node *ast_allocate(node_kind kind, ...) {
     break;
 
   case DECLARATIONS_NODE:
-    n->declarations.declarations = new std::list<node *>();
+    n->declarations.declarations = new node_list();
     break;
   case DECLARATION_NODE:
     n->declaration.is_const = (bool) va_arg(args, int);
@@ -82,7 +89,7 @@ node *ast_allocate(node_kind kind, ...) {
     break;
 
   case STATEMENTS_NODE:
-    n->statements.statements = new std::list<node *>();
+    n->statements.statements = new node_list();
     break;
   case IF_STATEMENT_NODE:
     n->statement.if_else_statement.condition = va_arg(args, node *);
@@ -233,11 +240,13 @@ void free_postorder(node *n, void *data) {
     delete n->statements.statements;
     break;
   case IDENT_NODE:
+    memory_freed(MEMORY_AST, strlen(n->expression.ident.val) + 1);
     free(n->expression.ident.val);
     break;
   default:
     break;
   }
+  memory_freed(MEMORY_AST, sizeof(node));
   free(n);
 }
 
@@ -419,7 +428,7 @@ void ast_visit(node *n,
       preorder(n, data);
     }
 
-    std::list<node *>::iterator iter;
+    node_list::iterator iter;
 
     switch (n->kind) {
     case SCOPE_NODE:
@@ -463,8 +472,13 @@ void ast_visit(node *n,
       ast_visit(n->expression.unary.right, preorder, postorder, data);
       break;
     case BINARY_EXPRESSION_NODE:
-      ast_visit(n->expression.binary.left, preorder, postorder, data);
-      ast_visit(n->expression.binary.right, preorder, postorder, data);
+      if (n->expression.binary.right_first) {
+        ast_visit(n->expression.binary.right, preorder, postorder, data);
+        ast_visit(n->expression.binary.left, preorder, postorder, data);
+      } else {
+        ast_visit(n->expression.binary.left, preorder, postorder, data);
+        ast_visit(n->expression.binary.right, preorder, postorder, data);
+      }
       break;
     case INT_NODE:
       // No children
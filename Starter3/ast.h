@@ -5,6 +5,8 @@
 #include <vector>
 #include <list>
 
+#include "accounting.h"
+
 // Dummy node just so everything compiles, create your own node/nodes
 //
 // The code provided below is an example ONLY. You can use/modify it,
@@ -19,6 +21,8 @@ struct node_;
 typedef struct node_ node;
 extern node *ast;
 
+typedef std::list<node *, tracked_allocator<node *, MEMORY_AST_LISTS> > node_list;
+
 typedef enum {
   UNKNOWN                = 0,
 
@@ -119,7 +123,7 @@ struct node_ {
     } scope;
 
     struct {
-      std::list<node *> *declarations;
+      node_list *declarations;
     } declarations;
 
     struct {
@@ -130,7 +134,7 @@ struct node_ {
     } declaration;
 
     struct {
-      std::list<node *> *statements;
+      node_list *statements;
     } statements;
 
     struct {
@@ -163,6 +167,9 @@ struct node_ {
           binary_op op;
           node *left;
           node *right;
+
+          // Visit the right operand before the left one
+          bool right_first;
         } binary;
 
         struct {
@@ -0,0 +1,93 @@
+#!/bin/bash
+
+# Compile generated programs of increasing size and report how fast the
+# compiler gets through them, to show whether it scales linearly.
+#
+# Usage: ./bench.sh [lines ...]
+# Without arguments the programs have 1K, 10K and 100K lines. Every program
+# is compiled at each optimization level in LEVELS ("-O0 -O2"), so that
+# the front end and the default pipeline are both measured. A program is
+# skipped if the peak memory of the last one, grown with the size, would
+# not fit in the available memory.
+#
+# Set COMPILER to use another compiler binary, FLAGS to add options to the
+# compiler and SHAPE to change the shape of the programs, for example
+# SHAPE="-e 5 -n 3" (see generate.c). SEED selects the programs.
+
+COMPILER=${COMPILER:-../compiler467}
+GENERATOR=${GENERATOR:-./generate}
+LEVELS=${LEVELS:--O0 -O2}
+FLAGS=${FLAGS:-}
+SHAPE=${SHAPE:-}
+SEED=${SEED:-1}
+
+if [[ $# -eq 0 ]]; then
+  set -- 1000 10000 100000
+fi
+
+PROGRAM=$(mktemp "${TMPDIR:-/tmp}/bench.XXXXXX")
+TRACE=$(mktemp "${TMPDIR:-/tmp}/bench.XXXXXX")
+trap 'rm -f $PROGRAM $TRACE' EXIT
+
+# The number in the JSON trace of the compiler after the key
+json_value() {
+  grep -o "\"$1\": [0-9.]*" $TRACE | tail -1 | sed -e 's/.*: //'
+}
+
+# The memory that can still be allocated in KB, or nothing if unknown
+available_kb() {
+  grep -s '^MemAvailable:' /proc/meminfo | awk '{ print $2 }'
+}
+
+# The exponent is how the time grew compared to the size since the last
+# program at the same level: 1 is linear and 2 quadratic
+printf "%10s %5s %10s %10s %12s %12s %12s %8s\n" \
+       "lines" "level" "nodes" "ms" "lines/s" "nodes/s" "peak RSS KB" "exponent"
+declare -A LAST_LINES LAST_MS LAST_RSS
+for LINES in "$@"; do
+  # The largest peak of the last program, grown with the size
+  NEEDED=0
+  for LEVEL in $LEVELS; do
+    if [[ -n ${LAST_RSS[$LEVEL]} ]]; then
+      GROWN=$(( ${LAST_RSS[$LEVEL]} * LINES / ${LAST_LINES[$LEVEL]} ))
+      [[ $GROWN -gt $NEEDED ]] && NEEDED=$GROWN
+    fi
+  done
+  AVAILABLE=$(available_kb)
+  if [[ -n $AVAILABLE && $NEEDED -gt $AVAILABLE ]]; then
+    printf "%10d %5s skipped, needs about %d KB with %d KB available\n" \
+           $LINES "" $NEEDED $AVAILABLE
+    break
+  fi
+
+  if ! $GENERATOR -s $SEED -l $LINES $SHAPE > $PROGRAM || [[ ! -s $PROGRAM ]]; then
+    echo "$GENERATOR failed to generate a program of $LINES lines"
+    exit 1
+  fi
+  LINES=$(wc -l < $PROGRAM)
+
+  for LEVEL in $LEVELS; do
+    rm -f $TRACE
+    if ! $COMPILER -X $LEVEL $FLAGS -Tj -R $TRACE -O /dev/null $PROGRAM 2> /dev/null ||
+       [[ -z $(json_value wall_ms) ]]; then
+      printf "%10d %5s %10s\n" $LINES $LEVEL "failed"
+      continue
+    fi
+
+    MS=$(grep -o '"total": {"wall_ms": [0-9.]*' $TRACE | sed -e 's/.*: //')
+    NODES=$(json_value nodes)
+    RSS=$(json_value peak_rss_kb)
+    awk -v lines=$LINES -v level=$LEVEL -v nodes=$NODES -v ms=$MS -v rss=$RSS \
+        -v last_lines=${LAST_LINES[$LEVEL]} -v last_ms=${LAST_MS[$LEVEL]} '
+      BEGIN {
+        exponent = "-"
+        if (last_lines != "" && lines > last_lines && ms > 0 && last_ms > 0)
+          exponent = sprintf("%.2f", log(ms / last_ms) / log(lines / last_lines))
+        printf "%10d %5s %10d %10.1f %12.0f %12.0f %12d %8s\n", lines, level, nodes, ms,
+               lines * 1000 / ms, nodes * 1000 / ms, rss, exponent
+      }'
+    LAST_LINES[$LEVEL]=$LINES
+    LAST_MS[$LEVEL]=$MS
+    LAST_RSS[$LEVEL]=$RSS
+  done
+done
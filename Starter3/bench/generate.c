@@ -0,0 +1,426 @@
+/***********************************************************************
+ * generate.c
+ *
+ * Generates a random, well typed program in the CSC467F course project
+ * language to benchmark the compiler with. The same seed and shape always
+ * generate the same program.
+ *
+ * Usage: generate [-s seed] [-l lines] [-d declarations] [-e depth]
+ *                 [-w width] [-n nesting] [-v vectors] [-b builtins]
+ **********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/****** SHAPE ******/
+
+typedef struct {
+  unsigned long seed;
+  long lines;        // Stop once the program has at least this many lines
+  int declarations;  // Declarations at the start of every scope
+  int depth;         // Depth of the operations in an expression
+  int width;         // Terms of the sum or conjunction that every expression is
+  int nesting;       // Depth of the ifs and scopes in a block
+  int vectors;       // Percentage of variables that are vectors
+  int builtins;      // Percentage of operations that call dp3, lit or rsq
+} shape;
+
+static shape options = { 1, 1000, 4, 2, 2, 2, 40, 10 };
+
+/****** RANDOM NUMBERS ******/
+/*
+ * splitmix64, so that the programs don't depend on the C library
+ */
+
+static unsigned long state;
+
+static unsigned long next_random() {
+  unsigned long z = (state += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+// A number from 0 to n - 1
+static int random_below(int n) {
+  return (int) (next_random() % n);
+}
+
+static bool percent(int p) {
+  return random_below(100) < p;
+}
+
+/****** TYPES AND VARIABLES ******/
+
+typedef enum { BASE_INT, BASE_FLOAT, BASE_BOOL } base_type;
+
+typedef struct {
+  base_type base;
+  int size;
+} var_type;
+
+typedef struct {
+  std::string name;
+  var_type type;
+  bool writable;
+} variable;
+
+static const char *type_name(var_type t) {
+  static const char *names[3][5] = {
+    { "", "int", "ivec2", "ivec3", "ivec4" },
+    { "", "float", "vec2", "vec3", "vec4" },
+    { "", "bool", "bvec2", "bvec3", "bvec4" },
+  };
+  return names[t.base][t.size];
+}
+
+static bool same_type(var_type a, var_type b) {
+  return a.base == b.base && a.size == b.size;
+}
+
+static const var_type VEC4 = { BASE_FLOAT, 4 };
+
+// The predefined variables that can be read
+static const char *inputs[] = {
+  "gl_FragCoord", "gl_TexCoord", "gl_Color", "gl_Secondary",
+  "gl_Light_Half", "gl_Light_Ambient", "env1", "env2", "env3",
+};
+
+// The variables in every open scope, innermost last
+static std::vector<std::vector<variable> > scopes;
+static int names;
+
+static var_type random_type() {
+  var_type t;
+  int b = random_below(10);
+  t.base = b < 5 ? BASE_FLOAT : b < 8 ? BASE_INT : BASE_BOOL;
+  t.size = percent(options.vectors) ? 2 + random_below(3) : 1;
+  return t;
+}
+
+// The visible variables of the type, or of the base type with more than
+// one component if size is 0. Inner variables are never shadowed since
+// every name is new
+static std::vector<const variable *> visible(var_type t, bool writable) {
+  std::vector<const variable *> found;
+  for (size_t s = 0; s < scopes.size(); s++) {
+    for (size_t v = 0; v < scopes[s].size(); v++) {
+      const variable &var = scopes[s][v];
+      if (writable && !var.writable) {
+        continue;
+      }
+      if (var.type.base == t.base && (t.size == 0 ? var.type.size > 1 : var.type.size == t.size)) {
+        found.push_back(&var);
+      }
+    }
+  }
+  return found;
+}
+
+/****** OUTPUT ******/
+
+static long lines;
+
+static void line(int indent, const std::string &text) {
+  printf("%*s%s\n", 2 * indent, "", text.c_str());
+  lines++;
+}
+
+/****** EXPRESSIONS ******/
+
+static std::string expression(var_type t, int depth);
+
+static std::string literal(base_type base) {
+  static const char *floats[] = { "0.0", "0.5", "1.0", "2.0", "0.25", "3.0" };
+  char text[32];
+  switch (base) {
+    case BASE_INT:
+      snprintf(text, sizeof(text), "%d", random_below(10));
+      return text;
+    case BASE_FLOAT:
+      if (percent(50)) {
+        return floats[random_below(6)];
+      }
+      snprintf(text, sizeof(text), "%d.%02d", random_below(4), random_below(100));
+      return text;
+    default:
+      return percent(50) ? "true" : "false";
+  }
+}
+
+static std::string constructor(var_type t, int depth) {
+  var_type scalar = { t.base, 1 };
+  std::string text = std::string(type_name(t)) + "(";
+  for (int i = 0; i < t.size; i++) {
+    text += (i == 0 ? "" : ", ") + expression(scalar, depth - 1);
+  }
+  return text + ")";
+}
+
+// A variable, a component of a vector or a literal
+static std::string leaf(var_type t) {
+  int choice = random_below(10);
+  if (choice < 5) {
+    std::vector<const variable *> vars = visible(t, false);
+    if (same_type(t, VEC4) && (vars.empty() || percent(30))) {
+      return inputs[random_below(sizeof(inputs) / sizeof(inputs[0]))];
+    }
+    if (!vars.empty()) {
+      return vars[random_below(vars.size())]->name;
+    }
+  } else if (choice < 8 && t.size == 1) {
+    var_type vector = { t.base, 0 };
+    std::vector<const variable *> vars = visible(vector, false);
+    if (!vars.empty()) {
+      const variable *var = vars[random_below(vars.size())];
+      return var->name + "[" + std::to_string(random_below(var->type.size)) + "]";
+    }
+  }
+  if (t.size > 1) {
+    return constructor(t, 1);
+  }
+  return literal(t.base);
+}
+
+// dp3, rsq or lit, if one of them has the type
+static std::string builtin(var_type t, int depth) {
+  if (t.size == 1 && t.base != BASE_BOOL && percent(70)) {
+    var_type vector = { t.base, 3 + random_below(2) };
+    return "dp3(" + expression(vector, depth - 1) + ", " + expression(vector, depth - 1) + ")";
+  }
+  if (t.size == 1 && t.base == BASE_FLOAT) {
+    std::string x = expression(t, depth - 1);
+    return "rsq(" + x + " * " + x + " + 0.5)";
+  }
+  if (same_type(t, VEC4)) {
+    return "lit(" + expression(t, depth - 1) + ")";
+  }
+  return "";
+}
+
+static std::string arithmetic(var_type t, int depth) {
+  var_type scalar = { t.base, 1 };
+  std::string one = t.base == BASE_FLOAT ? "1.0" : "1";
+  switch (random_below(t.size == 1 ? 9 : 6)) {
+    case 0:
+      return "(" + expression(t, depth - 1) + " + " + expression(t, depth - 1) + ")";
+    case 1:
+      return "(" + expression(t, depth - 1) + " - " + expression(t, depth - 1) + ")";
+    case 2:
+      return "(" + expression(t, depth - 1) + " * " + expression(t, depth - 1) + ")";
+    case 3:
+      return "-" + expression(t, depth - 1);
+    case 4:
+      return constructor(t, depth);
+    case 5:
+      if (t.size > 1) {
+        return "(" + expression(t, depth - 1) + " * " + expression(scalar, depth - 1) + ")";
+      }
+      return expression(t, depth - 1);
+    case 6:
+    case 7: {
+      // Divisors and bases of powers are kept positive
+      std::string x = expression(t, depth - 1);
+      return "(" + expression(t, depth - 1) + " / (" + x + " * " + x + " + " + one + "))";
+    }
+    default: {
+      std::string x = expression(t, depth - 1);
+      std::string exponent = t.base == BASE_FLOAT ? "2.0" : "2";
+      return "((" + x + " * " + x + " + " + one + ") ^ " + exponent + ")";
+    }
+  }
+}
+
+static std::string logical(var_type t, int depth) {
+  int choice = random_below(t.size == 1 ? 6 : 4);
+  if (choice == 0) {
+    return "(" + expression(t, depth - 1) + " && " + expression(t, depth - 1) + ")";
+  } else if (choice == 1) {
+    return "(" + expression(t, depth - 1) + " || " + expression(t, depth - 1) + ")";
+  } else if (choice == 2) {
+    return "!" + expression(t, depth - 1);
+  } else if (choice == 3) {
+    return constructor(t, depth);
+  }
+
+  // Comparisons of scalars, and equality of vectors as well
+  static const char *orders[] = { "<", "<=", ">", ">=", "==", "!=" };
+  var_type operands = { percent(50) ? BASE_FLOAT : BASE_INT, 1 };
+  const char *op = orders[random_below(6)];
+  if (choice == 5) {
+    operands.size = 1 + random_below(4);
+    op = percent(50) ? "==" : "!=";
+  }
+  return "(" + expression(operands, depth - 1) + " " + op + " " + expression(operands, depth - 1) + ")";
+}
+
+static std::string expression(var_type t, int depth) {
+  if (depth <= 0 || percent(20)) {
+    return leaf(t);
+  }
+  if (percent(options.builtins)) {
+    std::string call = builtin(t, depth);
+    if (!call.empty()) {
+      return call;
+    }
+  }
+  return t.base == BASE_BOOL ? logical(t, depth) : arithmetic(t, depth);
+}
+
+// The terms of the top of an expression
+static std::string wide_expression(var_type t) {
+  std::string text = expression(t, options.depth);
+  for (int i = 1; i < options.width; i++) {
+    const char *op = t.base != BASE_BOOL ? " + " : percent(50) ? " && " : " || ";
+    text += op + expression(t, options.depth);
+  }
+  return text;
+}
+
+/****** STATEMENTS ******/
+
+static std::string new_name() {
+  return "v" + std::to_string(++names);
+}
+
+static void declarations(int indent, int count) {
+  for (int i = 0; i < count; i++) {
+    variable var = { new_name(), random_type(), true };
+    std::string type = type_name(var.type);
+    // Constants can only be initialized with literals
+    if (var.type.base != BASE_BOOL && var.type.size == 1 && percent(20)) {
+      var.writable = false;
+      line(indent, "const " + type + " " + var.name + " = " + literal(var.type.base) + ";");
+    } else {
+      line(indent, type + " " + var.name + " = " + wide_expression(var.type) + ";");
+    }
+    scopes.back().push_back(var);
+  }
+}
+
+static void statement(int indent, int level);
+
+// The declarations and statements of a scope, which is at the level
+static void scope_body(int indent, int level, int statements) {
+  scopes.push_back(std::vector<variable>());
+  declarations(indent, options.declarations);
+  for (int i = 0; i < statements; i++) {
+    statement(indent, level);
+  }
+  scopes.pop_back();
+}
+
+static void assignment(int indent) {
+  std::vector<const variable *> targets;
+  for (int i = 0; i < 4 && targets.empty(); i++) {
+    targets = visible(random_type(), true);
+  }
+  if (targets.empty()) {
+    targets = visible(VEC4, true);
+  }
+  const variable *var = targets[random_below(targets.size())];
+  if (var->type.size > 1 && percent(40)) {
+    var_type scalar = { var->type.base, 1 };
+    line(indent, var->name + "[" + std::to_string(random_below(var->type.size)) + "] = " +
+                 wide_expression(scalar) + ";");
+  } else {
+    line(indent, var->name + " = " + wide_expression(var->type) + ";");
+  }
+}
+
+static void statement(int indent, int level) {
+  int choice = random_below(100);
+  if (level < options.nesting && choice < 25) {
+    var_type condition = { BASE_BOOL, 1 };
+    line(indent, "if (" + wide_expression(condition) + ") {");
+    scope_body(indent + 1, level + 1, 1 + random_below(3));
+    if (percent(50)) {
+      line(indent, "} else {");
+      scope_body(indent + 1, level + 1, 1 + random_below(3));
+    }
+    line(indent, "}");
+  } else if (level < options.nesting && choice < 35) {
+    line(indent, "{");
+    scope_body(indent + 1, level + 1, 1 + random_below(3));
+    line(indent, "}");
+  } else {
+    assignment(indent);
+  }
+}
+
+// A scope that adds one of its variables to acc, so that none of it is
+// dead code
+static void block(int indent) {
+  line(indent, "{");
+  scopes.push_back(std::vector<variable>());
+  declarations(indent + 1, options.declarations > 0 ? options.declarations : 1);
+  int statements = 2 + random_below(4);
+  for (int i = 0; i < statements; i++) {
+    statement(indent + 1, 0);
+  }
+
+  const variable &var = scopes.back()[random_below(scopes.back().size())];
+  std::string value = var.name;
+  if (var.type.size > 1) {
+    value += "[" + std::to_string(random_below(var.type.size)) + "]";
+  }
+  std::string acc = "acc[" + std::to_string(random_below(4)) + "]";
+  if (var.type.base == BASE_FLOAT) {
+    line(indent + 1, acc + " = " + acc + " * 0.5 + " + value + ";");
+  } else if (var.type.base == BASE_INT) {
+    line(indent + 1, "if (" + value + " > 2) " + acc + " = " + acc + " + 1.0;");
+  } else {
+    line(indent + 1, "if (" + value + ") " + acc + " = " + acc + " + 0.125;");
+  }
+  scopes.pop_back();
+  line(indent, "}");
+}
+
+static void program() {
+  state = options.seed;
+  line(0, "{");
+  scopes.push_back(std::vector<variable>());
+  declarations(1, options.declarations);
+  line(1, "vec4 acc = vec4(0.0, 0.0, 0.0, 0.0);");
+  variable acc = { "acc", VEC4, true };
+  scopes.back().push_back(acc);
+  while (lines < options.lines - 2) {
+    block(1);
+  }
+  line(1, "gl_FragColor = acc;");
+  scopes.pop_back();
+  line(0, "}");
+}
+
+/****** OPTIONS ******/
+
+static void usage() {
+  fprintf(stderr, "Usage: generate [-s seed] [-l lines] [-d declarations] [-e depth]\n"
+                  "                [-w width] [-n nesting] [-v vectors] [-b builtins]\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 == argc) {
+      usage();
+    }
+    long value = atol(argv[++i]);
+    switch (argv[i - 1][1]) {
+      case 's': options.seed = value; break;
+      case 'l': options.lines = value; break;
+      case 'd': options.declarations = value; break;
+      case 'e': options.depth = value; break;
+      case 'w': options.width = value > 0 ? value : 1; break;
+      case 'n': options.nesting = value; break;
+      case 'v': options.vectors = value; break;
+      case 'b': options.builtins = value; break;
+      default: usage();
+    }
+  }
+
+  program();
+  return 0;
+}
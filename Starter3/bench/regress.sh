@@ -0,0 +1,168 @@
+#!/bin/bash
+
+# Measure the compiler on every test and on generated programs, and
+# compare the results against a baseline to catch performance regressions.
+#
+# Usage: ./regress.sh [-b] [input ...]
+# With -b the results become the new baseline, otherwise they are compared
+# against it and the exit status is the number of regressions. Without
+# inputs every .in file of ../test and ../semantic_test is measured, as
+# well as generated programs of the sizes in GENERATED ("1000 10000").
+#
+# The inputs are compiled REPEAT (5) times in turn, so that the machine
+# warming up or slowing down affects all of them alike. The compile time of
+# an input is the median, with the median absolute deviation (MAD) as its
+# noise. A time is a regression if the median grew by more than THRESHOLD
+# percent (10), by more than 3 MADs and by at least MIN_MS (1). Peak
+# memory is a regression past THRESHOLD, and the instructions, TEMPs and
+# estimated cycles of the code, which don't vary between runs, are
+# regressions whenever they grow. Set COMPILER to use another compiler
+# binary and BASELINE to use another baseline file.
+
+COMPILER=${COMPILER:-../compiler467}
+GENERATOR=${GENERATOR:-./generate}
+GENERATED=${GENERATED-1000 10000}
+REPEAT=${REPEAT:-5}
+THRESHOLD=${THRESHOLD:-10}
+MIN_MS=${MIN_MS:-1}
+BASELINE=${BASELINE:-baseline.out}
+RESULTS_FILE="results.out"
+
+if [[ $1 == '-b' ]]; then
+  RECORD=1
+  shift
+fi
+
+if [[ $RECORD -ne 1 && ! -f $BASELINE ]]; then
+  echo "No baseline in $BASELINE, record one with $0 -b"
+  exit 1
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/regress.XXXXXX")
+trap 'rm -rf $WORK' EXIT
+
+if [[ $# -eq 0 ]]; then
+  INPUTS=$(find ../test ../semantic_test -name '*.in' | sort)
+  for LINES in $GENERATED; do
+    $GENERATOR -s 1 -l $LINES > $WORK/generated-$LINES.in
+    INPUTS="$INPUTS $WORK/generated-$LINES.in"
+  done
+else
+  INPUTS="$@"
+fi
+
+# The number after the first or the last occurrence of the key in a file
+first_value() {
+  grep -o "\"$1\": [0-9.]*" $2 | head -1 | sed -e 's/.*: //'
+}
+last_value() {
+  grep -o "\"$1\": [0-9.]*" $2 | tail -1 | sed -e 's/.*: //'
+}
+
+# The median and the median absolute deviation of the numbers on stdin
+median_mad() {
+  awk '
+    function median(values, n,   i, j, t) {
+      for (i = 2; i <= n; i++) {
+        for (j = i; j > 1 && values[j - 1] > values[j]; j--) {
+          t = values[j]; values[j] = values[j - 1]; values[j - 1] = t
+        }
+      }
+      return n % 2 ? values[(n + 1) / 2] : (values[n / 2] + values[n / 2 + 1]) / 2
+    }
+    { values[NR] = $1 }
+    END {
+      m = median(values, NR)
+      for (i = 1; i <= NR; i++) {
+        deviations[i] = values[i] > m ? values[i] - m : m - values[i]
+      }
+      printf "%.3f %.3f", m, median(deviations, NR)
+    }'
+}
+
+# Every run of every input, with the compile time and the peak RSS. The
+# first run also keeps the peak accounted bytes and the cost of the code
+> $WORK/runs
+> $WORK/first
+for ((RUN = 1; RUN <= REPEAT; RUN++)); do
+  for INPUT in $INPUTS; do
+    NAME=$(echo $INPUT | sed -e "s|^$WORK/||" -e 's|^\.\./||')
+    rm -f $WORK/trace $WORK/cost
+    $COMPILER -X -Tj -R $WORK/trace -Dj -U $WORK/cost -O /dev/null $INPUT > /dev/null 2>&1
+    TIME=$(grep -o '"total": {"wall_ms": [0-9.]*' $WORK/trace 2> /dev/null | sed -e 's/.*: //')
+    if [[ -z $TIME ]]; then
+      echo "$0: $NAME didn't run" >&2
+      continue
+    fi
+    echo "$NAME $RUN $TIME $(last_value peak_rss_kb $WORK/trace)" >> $WORK/runs
+    if [[ $RUN -eq 1 ]]; then
+      INSTRUCTIONS=$(first_value instructions $WORK/cost)
+      TEMPS=$(first_value temps $WORK/cost)
+      CYCLES=$(first_value cycles $WORK/cost)
+      echo "$NAME $(last_value peak $WORK/trace) ${INSTRUCTIONS:--} ${TEMPS:--} ${CYCLES:--}" >> $WORK/first
+    fi
+  done
+done
+
+# One line per input with the median and MAD of the compile time in ms,
+# the peak accounted bytes, the median peak RSS in KB and the
+# instructions, TEMPs and cycles of the code, or - if it didn't compile
+> $RESULTS_FILE
+while read NAME PEAK INSTRUCTIONS TEMPS CYCLES; do
+  TIME=$(awk -v name=$NAME '$1 == name { print $3 }' $WORK/runs | median_mad)
+  RSS=$(awk -v name=$NAME '$1 == name { print $4 }' $WORK/runs | median_mad | awk '{ print int($1) }')
+  echo "$NAME $TIME $PEAK $RSS $INSTRUCTIONS $TEMPS $CYCLES" >> $RESULTS_FILE
+done < $WORK/first
+
+# The time of the whole corpus, from the sum of every run
+awk '{ sums[$2] += $3 } END { for (run in sums) print sums[run] }' $WORK/runs |
+  median_mad > $WORK/total
+echo "total $(cat $WORK/total) - - - - -" >> $RESULTS_FILE
+
+if [[ $RECORD -eq 1 ]]; then
+  mv $RESULTS_FILE $BASELINE
+  echo "Recorded $(($(wc -l < $BASELINE) - 1)) inputs in $BASELINE"
+  exit 0
+fi
+
+awk -v threshold=$THRESHOLD -v min_ms=$MIN_MS '
+  # Whether the value grew by more than the threshold and the noise
+  function slower(old, new, old_mad, new_mad, least,   noise) {
+    noise = 3 * (old_mad > new_mad ? old_mad : new_mad)
+    return new > old * (1 + threshold / 100) && new - old > noise && new - old >= least
+  }
+  function report(metric, old, new) {
+    printf "%-48s %-12s %12s -> %-12s\n", name, metric, old, new
+    regressions++
+  }
+  NR == FNR { baseline[$1] = $0; next }
+  {
+    name = $1
+    if (!(name in baseline)) {
+      next
+    }
+    split(baseline[name], old)
+    compared++
+    if (slower(old[2], $2, old[3], $3, min_ms)) {
+      report("ms", old[2], $2)
+    }
+    if ($4 != "-" && slower(old[4], $4, 0, 0, 0)) {
+      report("peak bytes", old[4], $4)
+    }
+    if ($5 != "-" && slower(old[5], $5, 0, 0, 0)) {
+      report("peak RSS KB", old[5], $5)
+    }
+    if ($6 != "-" && old[6] != "-" && $6 > old[6]) {
+      report("instructions", old[6], $6)
+    }
+    if ($7 != "-" && old[7] != "-" && $7 > old[7]) {
+      report("TEMPs", old[7], $7)
+    }
+    if ($8 != "-" && old[8] != "-" && $8 > old[8]) {
+      report("cycles", old[8], $8)
+    }
+  }
+  END {
+    printf "%d of %d inputs compared, %d regressions\n", compared, FNR, regressions
+    exit regressions > 255 ? 255 : regressions
+  }' $BASELINE $RESULTS_FILE
@@ -1,42 +1,82 @@
 #include "codegen.h"
 #include "common.h"
+#include "ir.h"
+#include "passes.h"
+#include "cost.h"
+#include "target.h"
+#include "timing.h"
+#include <math.h>
 #include <vector>
 #include <map>
 #include <string>
 
-#define START_INSTR(instr) { \
-  fprintf(outputFile, instr " "); \
-}
-
-#define INSTR(fmt, ...) { \
-  fprintf(outputFile, fmt, ##__VA_ARGS__); \
-}
+// The program that is being generated
+ir_program program;
 
-#define FINISH_INSTR() { \
-  fprintf(outputFile, ";\n"); \
-}
+typedef std::map<std::string, int, std::less<std::string>,
+                 tracked_allocator<std::pair<const std::string, int>, MEMORY_REGISTERS> > register_map;
+typedef std::map<node *, int, std::less<node *>,
+                 tracked_allocator<std::pair<node * const, int>, MEMORY_REGISTERS> > node_register_map;
 
 // Map variables to registers
-std::vector<std::map<std::string, std::string> > register_tables;
+std::vector<register_map, tracked_allocator<register_map, MEMORY_REGISTERS> > register_tables;
 
-// Map expression nodes to intermediate register number
-std::map<node *, unsigned int> intermediate_registers;
+// Map expression nodes to intermediate registers
+node_register_map intermediate_registers;
 
 // Map constant nodes to PARAM registers
-std::map<node *, unsigned int> constant_registers;
+node_register_map constant_registers;
+
+// Map expressions that are computed directly into the variable they are
+// assigned to, to that variable
+std::map<node *, node *> destinations;
+
+// Predefined registers. Booleans are encoded as 0 for false and 1 for true
+int false_register;
+int true_register;
+
+// The predicate under which the statements in one branch of an if statement
+// are executed. The branch is executed when selector is negative, or when
+// it isn't negative if inverted is set. This is the form that CMP reads
+typedef struct {
+  ir_src selector;
+  bool inverted;
+} predicate;
+
+// Map if statements to the predicate of their if branch
+std::map<node *, predicate> conditions;
+
+// Where one entry of a variable is held while the variable is assigned in a
+// branch of an if statement
+typedef struct {
+  int reg;
+  int component;
+  bool negate;
+} component_value;
+
+// The values assigned to variables in one branch of an if statement, keyed
+// by the variable's register and entry
+typedef std::map<std::pair<int, int>, component_value> branch_values;
+
+// The branches that are being generated, innermost last
+std::vector<branch_values> branches;
+
+// Map the branches of if statements to the values assigned in them
+std::map<node *, branch_values> assigned_values;
 
 typedef struct {
   std::vector<unsigned int> scope_id_stack;
-  unsigned int constant_id;
 } visit_data;
 
-std::pair<const char *, unsigned int> get_register_name(const std::vector<unsigned int> &scope_id_stack,
-                                                        node *var);
-void print_index(int i);
-void print_register_name(const std::vector<unsigned int> &scope_id_stack,
-                         node *n,
-                         bool force_print_index = false);
+int get_variable_register(const std::vector<unsigned int> &scope_id_stack, node *var);
+int get_register(const std::vector<unsigned int> &scope_id_stack, node *n);
+ir_dst get_dst(const std::vector<unsigned int> &scope_id_stack, node *n);
+ir_src get_src(const std::vector<unsigned int> &scope_id_stack, node *n);
 bool is_register_temporary(node *expr);
+bool is_register_constant(node *expr);
+bool is_fused_condition(node *n);
+ir_src generate_distance_code(const std::vector<unsigned int> &scope_id_stack,
+                              int reg, node *left, node *right);
 void generate_expression(visit_data *vd, node *n);
 void generate_const_int(visit_data *vd, node *int_expr);
 void generate_const_float(visit_data *vd, node *float_expr);
@@ -44,6 +84,9 @@ void generate_if_statement_code(const std::vector<unsigned int> &scope_id_stack,
                                 node *if_statement);
 void generate_assignment_code(const std::vector<unsigned int> &scope_id_stack,
                               node *assign);
+void generate_select_code(node *if_statement);
+void set_destination(const std::vector<unsigned int> &scope_id_stack,
+                     node *variable, node *expression);
 void generate_unary_expr_code(const std::vector<unsigned int> &scope_id_stack,
                                node *n);
 void generate_binary_expr_code(const std::vector<unsigned int> &scope_id_stack,
@@ -53,16 +96,27 @@ void generate_function_code(const std::vector<unsigned int> &scope_id_stack,
 void generate_constructor_code(const std::vector<unsigned int> &scope_id_stack,
                                node *assign);
 
+// Checks if n is the if or else branch of an if statement
+bool is_branch(node *n) {
+  return n->parent != NULL && n->parent->kind == IF_STATEMENT_NODE &&
+         n != n->parent->statement.if_else_statement.condition;
+}
+
 void codegen_preorder(node *n, void *data) {
   visit_data *vd = (visit_data *) data;
 
+  if (is_branch(n)) {
+    branches.push_back(branch_values());
+  }
+
   char *str;
+  std::string reg_name;
 
   switch (n->kind) {
   case SCOPE_NODE:
     vd->scope_id_stack.push_back(n->scope.scope_id);
     if (vd->scope_id_stack.back() != 0) {
-      register_tables.push_back(std::map<std::string, std::string>());
+      register_tables.push_back(register_map());
     }
     break;
 
@@ -70,24 +124,32 @@ void codegen_preorder(node *n, void *data) {
     break;
   case DECLARATION_NODE:
     str = n->declaration.identifier->expression.ident.val;
+    // Append the scope id to the register if the scope is greater than 1
+    reg_name = str;
+    if (vd->scope_id_stack.back() > 0) {
+      char scope_suffix[16];
+      snprintf(scope_suffix, sizeof(scope_suffix), "_%d", vd->scope_id_stack.back());
+      reg_name += scope_suffix;
+    }
     // Assign this variable to the corresponding register
-    register_tables[vd->scope_id_stack.back()][str] = str;
-
-    START_INSTR("TEMP");
-    print_register_name(vd->scope_id_stack, n->declaration.identifier);
-    FINISH_INSTR();
+    register_tables[vd->scope_id_stack.back()][str] =
+      ir_add_register(program, REGISTER_VARIABLE, reg_name);
+    if (n->declaration.assignment_expr != NULL) {
+      set_destination(vd->scope_id_stack, n->declaration.identifier,
+                      n->declaration.assignment_expr);
+    }
     break;
 
   case STATEMENTS_NODE:
     break;
   case IF_STATEMENT_NODE:
-    // The if statement is responsible for generating its own condition code
-    // since the if is generated in preorder but expressions are generated in
-    // postorder
-    generate_expression(vd, n->statement.if_else_statement.condition);
-    generate_if_statement_code(vd->scope_id_stack, n);
     break;
   case ASSIGNMENT_NODE:
+    // Assignments in branches are merged into selects instead
+    if (branches.empty()) {
+      set_destination(vd->scope_id_stack, n->statement.assignment.variable,
+                      n->statement.assignment.expression);
+    }
     break;
   case NESTED_SCOPE_NODE:
     break;
@@ -129,34 +191,34 @@ void codegen_postorder(node *n, void *data) {
 
   switch (n->kind) {
   case SCOPE_NODE:
+    // Variables declared in a branch don't need to be selected after it
+    if (!branches.empty()) {
+      register_map &register_table = register_tables[n->scope.scope_id];
+      register_map::iterator iter;
+      for (iter = register_table.begin(); iter != register_table.end(); iter++) {
+        for (int c = 0; c < 4; c++) {
+          branches.back().erase(std::pair<int, int>(iter->second, c));
+        }
+      }
+    }
     vd->scope_id_stack.pop_back();
     break;
 
   case DECLARATIONS_NODE:
     break;
   case DECLARATION_NODE:
-    if (n->declaration.assignment_expr != NULL){
-      START_INSTR("MOV");
-      print_register_name(vd->scope_id_stack, n->declaration.identifier);
-      START_INSTR(", ");
-      print_register_name(vd->scope_id_stack, n->declaration.assignment_expr);    
-      FINISH_INSTR();
-      // If this is a scalar
-      if (!(n->declaration.assignment_expr->expression.expr_type & TYPE_ANY_VEC)) {
-        // Copy the first entry into all entries
-        START_INSTR("POW");
-        print_register_name(vd->scope_id_stack, n->declaration.identifier, true);
-        INSTR(", ");
-        print_register_name(vd->scope_id_stack, n->declaration.identifier, true);
-        INSTR(", ONE.x");
-        FINISH_INSTR();
-      }
+    if (n->declaration.assignment_expr != NULL &&
+        !destinations.count(n->declaration.assignment_expr)) {
+      ir_emit(program, IR_MOV,
+              get_dst(vd->scope_id_stack, n->declaration.identifier),
+              get_src(vd->scope_id_stack, n->declaration.assignment_expr));
     }
     break;
 
   case STATEMENTS_NODE:
     break;
   case IF_STATEMENT_NODE:
+    generate_select_code(n);
     break;
   case ASSIGNMENT_NODE:
     generate_assignment_code(vd->scope_id_stack, n);
@@ -174,13 +236,18 @@ void codegen_postorder(node *n, void *data) {
   case VAR_NODE:
   case FUNCTION_NODE:
   case CONSTRUCTOR_NODE:
-    // The if statement is responsible for generating its own condition code
-    // since the if is generated in preorder but expressions are generated in
-    // postorder
-    if (n->parent->kind != IF_STATEMENT_NODE ||
-        n != n->parent->statement.if_else_statement.condition) {
+    // Comparisons in the condition of an if statement are generated as part
+    // of its predicate
+    if (!is_fused_condition(n)) {
       generate_expression(vd, n);
     }
+    // The condition is visited before either branch of the if statement, so
+    // the if statement's condition register is set up as soon as the
+    // condition has been evaluated
+    if (n->parent->kind == IF_STATEMENT_NODE &&
+        n == n->parent->statement.if_else_statement.condition) {
+      generate_if_statement_code(vd->scope_id_stack, n->parent);
+    }
     break;
 
   case TYPE_NODE:
@@ -191,69 +258,103 @@ void codegen_postorder(node *n, void *data) {
 
   default: break;
   }
-}
 
-void register_assign_postorder(node *n, void *data) {
-  int *i = (int *) data;
-  if (is_register_temporary(n)) {
-    intermediate_registers[n] = *i;
-    START_INSTR("TEMP");
-    INSTR("tempVar%d", *i);
-    FINISH_INSTR();
-    *i = *i + 1;
+  if (is_branch(n)) {
+    assigned_values[n] = branches.back();
+    branches.pop_back();
   }
 }
 
-void assign_registers(node *ast) {
-  int i = 0;
+void add_builtin_register(const char *variable, const char *binding, bool write_only = false) {
+  int reg = ir_add_register(program, REGISTER_BUILTIN, binding);
+  program.registers[reg].write_only = write_only;
+  register_tables[0].insert(std::pair<std::string, int>(variable, reg));
+}
 
-  ast_visit(ast, NULL, register_assign_postorder, &i);
+void assign_registers(node *ast) {
+  // Registers that are used by the generated code
+  false_register = ir_constant(program, "FALSE", 0, 0, 0, 0);
+  true_register = ir_constant(program, "TRUE", 1, 1, 1, 1);
 
   // Mappings for global registers
-  register_tables.push_back(std::map<std::string, std::string>());
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_FragColor", "result.color"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_FragDepth", "result.depth"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_FragCoord", "fragment.position"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_TexCoord", "fragment.texcoord"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_Color", "fragment.color"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_Secondary", "fragment.color.secondary"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_FogFragCoord", "fragment.fogcoord"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_Light_Half", "state.light[0].half"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_Light_Ambient", "state.lightmodel.ambient"));
-  register_tables[0].insert(std::pair<std::string, std::string>("gl_Material_Shininess", "state.material.shininess"));
-  register_tables[0].insert(std::pair<std::string, std::string>("env1", "program.env[1]"));
-  register_tables[0].insert(std::pair<std::string, std::string>("env2", "program.env[2]"));
-  register_tables[0].insert(std::pair<std::string, std::string>("env3", "program.env[3]"));
+  register_tables.push_back(register_map());
+  add_builtin_register("gl_FragColor", "result.color", true);
+  add_builtin_register("gl_FragDepth", "result.depth", true);
+  add_builtin_register("gl_FragCoord", "fragment.position");
+  add_builtin_register("gl_TexCoord", "fragment.texcoord");
+  add_builtin_register("gl_Color", "fragment.color");
+  add_builtin_register("gl_Secondary", "fragment.color.secondary");
+  add_builtin_register("gl_FogFragCoord", "fragment.fogcoord");
+  add_builtin_register("gl_Light_Half", "state.light[0].half");
+  add_builtin_register("gl_Light_Ambient", "state.lightmodel.ambient");
+  add_builtin_register("gl_Material_Shininess", "state.material.shininess");
+  add_builtin_register("env1", "program.env[1]");
+  add_builtin_register("env2", "program.env[2]");
+  add_builtin_register("env3", "program.env[3]");
 }
 
 void genCode(node *ast) {
-  // Print the fragment shader header
-  INSTR("!!ARBfp1.0\n");
-
-  START_INSTR("PARAM");
-  INSTR("FALSE = { 0, 0, 0, 0 }");
-  FINISH_INSTR();
-  START_INSTR("PARAM");
-  INSTR("TRUE = { -1, -1, -1, -1 }");
-  FINISH_INSTR();
-  START_INSTR("PARAM");
-  INSTR("ONE = { 1, 1, 1, 1 }");
-  FINISH_INSTR();
-  START_INSTR("TEMP");
-  INSTR("_TEMP");
-  FINISH_INSTR();
+  ir_clear(program);
+  register_tables.clear();
+  intermediate_registers.clear();
+  constant_registers.clear();
+  destinations.clear();
+  conditions.clear();
+  branches.clear();
+  assigned_values.clear();
+
+  phase_begin(PHASE_OPTIMIZATION);
+  configure_passes(optimizationLevel, passList);
+  run_ast_passes(ast);
+  phase_end();
+
+  phase_begin(PHASE_REGISTERS);
+  assign_registers(ast);
+  phase_end();
 
   // Perform code generation
+  phase_begin(PHASE_CODEGEN);
   visit_data vd;
-  // Reserve tempVar[0..1] for binary and unary expressions
-  vd.constant_id = 0;
+  ast_visit(ast, codegen_preorder, codegen_postorder, &vd);
+  counters.emitted_instructions = program.instructions.size();
+  phase_end();
+
+  phase_begin(PHASE_OPTIMIZATION);
+  ir_program unpacked;
+  run_ir_passes(program, &unpacked);
+
+  if (targetLimits) {
+    target_limits limits;
+    if (!parse_target_limits(targetLimits, limits)) {
+      fprintf(errorFile, "Invalid target limits: %s\n", targetLimits);
+      errorOccurred = TRUE;
+    } else if (!fit_target_limits(program, unpacked, limits, errorFile)) {
+      errorOccurred = TRUE;
+    }
+  }
+  counters.instructions = program.instructions.size();
+  counters.temps = ir_cost(program).temps;
+  phase_end();
 
-  assign_registers(ast);
+  if (errorOccurred) {
+    fprintf(outputFile, "Failed to compile\n");
+    return;
+  }
 
-  ast_visit(ast, codegen_preorder, codegen_postorder, &vd);
+  // Print the fragment shader
+  phase_begin(PHASE_OUTPUT);
+  ir_print(outputFile, program);
 
-  // Print the fragment shader footer
-  INSTR("END\n");
+  if (dumpCost || dumpCostJSON) {
+    program_cost cost = ir_cost(program);
+    if (dumpCost) {
+      print_cost(dumpFile, cost);
+    }
+    if (dumpCostJSON) {
+      print_cost_json(dumpFile, cost);
+    }
+  }
+  phase_end();
 }
 
 bool is_register_temporary(node *expr) {
@@ -265,9 +366,7 @@ bool is_register_temporary(node *expr) {
   case IF_STATEMENT_NODE: // We need a register to store the if condition
     return true;
   case VAR_NODE:
-    // If this is a variable node that is referenced on the rhs and indexed
-    return (expr->parent->kind != ASSIGNMENT_NODE || expr->parent->statement.assignment.variable != expr) &&
-           expr->expression.variable.index != NULL;
+    // Indexed variables are read through a swizzle of the variable itself
   case INT_NODE:
   case FLOAT_NODE:
   case BOOL_NODE:
@@ -296,22 +395,22 @@ bool is_register_constant(node *expr) {
   }
 }
 
-std::pair<const char *, unsigned int> get_register_name(const std::vector<unsigned int> &scope_id_stack,
-                                                        node *n) {
+int get_variable_register(const std::vector<unsigned int> &scope_id_stack,
+                          node *n) {
   if (n->kind == VAR_NODE) {
-    return get_register_name(scope_id_stack, n->expression.variable.identifier);
+    return get_variable_register(scope_id_stack, n->expression.variable.identifier);
   }
 
   char *variable_name = n->expression.ident.val;
 
   std::vector<unsigned int>::const_reverse_iterator iter;
-  std::map<std::string, std::string>::iterator variable_iter;
+  register_map::iterator variable_iter;
 
   // Traverse the scope id stack backwards
   for (iter = scope_id_stack.rbegin(); iter != scope_id_stack.rend(); iter++) {
 
     // Look at the register table for each scope
-    std::map<std::string, std::string> &register_table = register_tables[*iter];
+    register_map &register_table = register_tables[*iter];
 
     // Search for the variable in the table
     variable_iter = register_table.find(variable_name);
@@ -321,49 +420,150 @@ std::pair<const char *, unsigned int> get_register_name(const std::vector<unsign
       break;
     }
   }
-  return std::make_pair(variable_iter->second.c_str(), *iter);
-}
-
-void print_index(int i) {
-  switch (i) {
-  case 0: INSTR(".x"); break;
-  case 1: INSTR(".y"); break;
-  case 2: INSTR(".z"); break;
-  case 3: INSTR(".w"); break;
-  default: break;
-  }
+  return variable_iter->second;
 }
 
-void print_register_name(const std::vector<unsigned int> &scope_id_stack,
-                         node *n,
-                         bool force_print_index) {
-  bool printed_index = false;
-  if (is_register_temporary(n)) {
-    INSTR("tempVar%d", intermediate_registers[n]);
+int get_register(const std::vector<unsigned int> &scope_id_stack, node *n) {
+  if (destinations.count(n)) {
+    return get_variable_register(scope_id_stack, destinations[n]);
+  } else if (is_register_temporary(n)) {
+    // Intermediate registers are allocated the first time they are needed
+    node_register_map::iterator iter = intermediate_registers.find(n);
+    if (iter != intermediate_registers.end()) {
+      return iter->second;
+    }
+    int reg = ir_temp(program);
+    intermediate_registers[n] = reg;
+    return reg;
   } else if (is_register_constant(n)) {
     if (n->kind == BOOL_NODE) {
-      INSTR(n->expression.bool_expr.val ? "TRUE" : "FALSE");
+      return n->expression.bool_expr.val ? true_register : false_register;
     } else {
-      INSTR("const%d", constant_registers[n]);
+      return constant_registers[n];
     }
   } else {
-    std::pair<const char *, unsigned int> pair = get_register_name(scope_id_stack, n);
-    // Append the scope id to the register if the scope is greater than 1
-    if (pair.second > 0) {
-      INSTR("%s_%d", pair.first, pair.second);
-    } else {
-      INSTR("%s", pair.first);
+    return get_variable_register(scope_id_stack, n);
+  }
+}
+
+// Returns the component of the register that holds the value of n, or
+// -1 if n is a vector that occupies the whole register
+int get_register_index(node *n) {
+  if (destinations.count(n)) {
+    return get_register_index(destinations[n]);
+  }
+  if (n->kind == VAR_NODE && n->expression.variable.index != NULL) {
+    // The explicit index
+    return n->expression.variable.index->expression.int_expr.val;
+  }
+  // Scalars are only held in the first entry. The condition of an if
+  // statement is a scalar as well
+  if (n->kind == IF_STATEMENT_NODE || !(n->expression.expr_type & TYPE_ANY_VEC)) {
+    return 0;
+  }
+  return -1;
+}
+
+// Scalars are only written to their own entry...
+ir_dst get_dst(const std::vector<unsigned int> &scope_id_stack, node *n) {
+  if (destinations.count(n)) {
+    n = destinations[n];
+  }
+  int index = get_register_index(n);
+  int reg = get_register(scope_id_stack, n);
+  // ...except for result registers, since result.depth is read from its z
+  // entry
+  if (program.registers[reg].write_only &&
+      (n->kind != VAR_NODE || n->expression.variable.index == NULL)) {
+    index = -1;
+  }
+  return ir_make_dst(reg, index < 0 ? MASK_XYZW : 1 << index);
+}
+
+// Returns where entry component of a variable's register is currently held
+component_value get_current_value(int reg, int component) {
+  std::pair<int, int> key(reg, component);
+  std::vector<branch_values>::reverse_iterator iter;
+  for (iter = branches.rbegin(); iter != branches.rend(); iter++) {
+    branch_values::iterator value = iter->find(key);
+    if (value != iter->end()) {
+      return value->second;
     }
-    // Print the explicit index
-    if (n->expression.variable.index != NULL) {
-      print_index(n->expression.variable.index->expression.int_expr.val);
-      printed_index = true;
+  }
+  component_value value = { reg, component, false };
+  return value;
+}
+
+bool is_same_value(const component_value &a, const component_value &b) {
+  return a.reg == b.reg && a.component == b.component && a.negate == b.negate;
+}
+
+// Redirects a source that reads a variable to where its entries are held
+// in the branches that are being generated. If they are held in different
+// registers then they are gathered into a temporary first
+ir_src read_current_value(ir_src src) {
+  if (branches.empty()) {
+    return src;
+  }
+
+  component_value values[4];
+  bool same_register = true;
+  for (int p = 0; p < 4; p++) {
+    values[p] = get_current_value(src.reg, src.swizzle[p]);
+    same_register = same_register && values[p].reg == values[0].reg &&
+                    values[p].negate == values[0].negate;
+  }
+
+  if (same_register) {
+    src.reg = values[0].reg;
+    for (int p = 0; p < 4; p++) {
+      src.swizzle[p] = values[p].component;
     }
+    src.negate = src.negate != values[0].negate;
+    return src;
   }
-  // If this register should be used as a scalar
-  if (!printed_index && force_print_index && !(n->expression.expr_type & TYPE_ANY_VEC)) {
-    print_index(0);
+
+  int temp = ir_temp(program);
+  unsigned char gathered = 0;
+  for (int p = 0; p < 4; p++) {
+    if (gathered & (1 << p)) {
+      continue;
+    }
+    ir_src part = ir_replicate(ir_make_src(values[p].reg), values[p].component);
+    part.negate = values[p].negate;
+    unsigned char mask = 0;
+    for (int q = p; q < 4; q++) {
+      if (values[q].reg == values[p].reg && values[q].negate == values[p].negate) {
+        part.swizzle[q] = values[q].component;
+        mask |= 1 << q;
+      }
+    }
+    ir_emit(program, IR_MOV, ir_make_dst(temp, mask), part);
+    gathered |= mask;
   }
+
+  ir_src result = ir_make_src(temp);
+  result.negate = src.negate;
+  return result;
+}
+
+// ...and are read with a replicate swizzle, so they are broadcast to every
+// entry of the consuming instruction without any extra instructions
+ir_src get_src(const std::vector<unsigned int> &scope_id_stack, node *n) {
+  // Unary minus is the negate modifier on the source that reads its operand,
+  // so it doesn't need any instructions or a register
+  if (n->kind == UNARY_EXPRESSION_NODE && n->expression.unary.op == OP_UMINUS) {
+    return ir_negate(get_src(scope_id_stack, n->expression.unary.right));
+  }
+  int index = get_register_index(n);
+  ir_src src = ir_make_src(get_register(scope_id_stack, n));
+  if (index >= 0) {
+    src = ir_replicate(src, index);
+  }
+  if (!is_register_temporary(n) && !is_register_constant(n)) {
+    src = read_current_value(src);
+  }
+  return src;
 }
 
 void generate_expression(visit_data *vd, node *expr) {
@@ -372,19 +572,9 @@ void generate_expression(visit_data *vd, node *expr) {
     // EXPRESSION_NODE is an abstract node
     break;
   case UNARY_EXPRESSION_NODE:
-    // Only traverse the root of the expression
-    /*if (n->parent != BINARY_EXPRESSION_NODE &&
-        n->parent != UNARY_EXPRESSION_NODE) {
-      generate_unary_expr_code(vd->scope_id_stack, n);
-    }*/
     generate_unary_expr_code(vd->scope_id_stack, expr);
     break;
   case BINARY_EXPRESSION_NODE:
-    // Only traverse the root of the expression
-    /*if (n->parent != BINARY_EXPRESSION_NODE &&
-        n->parent != UNARY_EXPRESSION_NODE) {
-      generate_binary_expr_code(vd->scope_id_stack, n);
-    }*/
     generate_binary_expr_code(vd->scope_id_stack, expr);
     break;
   case INT_NODE:
@@ -400,24 +590,6 @@ void generate_expression(visit_data *vd, node *expr) {
   case IDENT_NODE:
     break;
   case VAR_NODE:
-    // If this is a variable node that is referenced on the rhs
-    if (is_register_temporary(expr)) {
-      START_INSTR("MOV");
-      print_register_name(vd->scope_id_stack, expr);
-      INSTR(", ");
-      print_register_name(vd->scope_id_stack, expr->expression.variable.identifier);
-      FINISH_INSTR();
-      // If this is a scalar
-      if (!(expr->expression.expr_type & TYPE_ANY_VEC)) {
-        // Copy the first entry into all entries
-        START_INSTR("POW");
-        print_register_name(vd->scope_id_stack, expr, true);
-        INSTR(", ");
-        print_register_name(vd->scope_id_stack, expr, true);
-        INSTR(", ONE.x");
-        FINISH_INSTR();
-      }
-    }
     break;
   case FUNCTION_NODE:
     generate_function_code(vd->scope_id_stack, expr);
@@ -431,82 +603,365 @@ void generate_expression(visit_data *vd, node *expr) {
 }
 
 void generate_const_int(visit_data *vd, node *int_expr) {
-  constant_registers[int_expr] = vd->constant_id;
-  START_INSTR("PARAM");
-  INSTR("const%d = %d", vd->constant_id++, int_expr->expression.int_expr.val);
-  FINISH_INSTR();
+  float val = int_expr->expression.int_expr.val;
+  constant_registers[int_expr] = ir_constant(program, val, val, val, val);
 }
 
 void generate_const_float(visit_data *vd, node *float_expr) {
-  constant_registers[float_expr] = vd->constant_id;
-  START_INSTR("PARAM");
-  INSTR("const%d = %f", vd->constant_id++, float_expr->expression.float_expr.val);
-  FINISH_INSTR();
+  float val = float_expr->expression.float_expr.val;
+  constant_registers[float_expr] = ir_constant(program, val, val, val, val);
+}
+
+bool is_comparison(binary_op op) {
+  return op == OP_LT || op == OP_LEQ || op == OP_GT || op == OP_GEQ ||
+         op == OP_EQ || op == OP_NEQ;
+}
+
+bool is_zero_literal(node *n) {
+  return (n->kind == INT_NODE && n->expression.int_expr.val == 0) ||
+         (n->kind == FLOAT_NODE && n->expression.float_expr.val == 0.0f);
+}
+
+// Checks if n is a comparison or a ! that the predicate of an if statement
+// is computed from, i.e. there are only !s between n and the if statement
+bool is_fused_condition(node *n) {
+  if (n->kind == UNARY_EXPRESSION_NODE) {
+    if (n->expression.unary.op != OP_NOT) {
+      return false;
+    }
+  } else if (n->kind != BINARY_EXPRESSION_NODE ||
+             !is_comparison(n->expression.binary.op)) {
+    return false;
+  }
+
+  while (n->parent->kind == UNARY_EXPRESSION_NODE &&
+         n->parent->expression.unary.op == OP_NOT) {
+    n = n->parent;
+  }
+  return n->parent->kind == IF_STATEMENT_NODE &&
+         n == n->parent->statement.if_else_statement.condition;
+}
+
+predicate invert_predicate(predicate pred) {
+  pred.inverted = !pred.inverted;
+  return pred;
+}
+
+// Computes left - right into the if statement's register, which is negative
+// when left < right. Nothing is emitted when either side is 0
+ir_src generate_difference_code(const std::vector<unsigned int> &scope_id_stack,
+                                node *if_statement, node *left, node *right) {
+  if (is_zero_literal(right)) {
+    return get_src(scope_id_stack, left);
+  }
+  if (is_zero_literal(left)) {
+    return ir_negate(get_src(scope_id_stack, right));
+  }
+  ir_emit(program, IR_SUB,
+          get_dst(scope_id_stack, if_statement),
+          get_src(scope_id_stack, left),
+          get_src(scope_id_stack, right));
+  return get_src(scope_id_stack, if_statement);
+}
+
+// Returns the predicate under which the if branch of an if statement is
+// executed. Comparisons are turned into a sign that CMP selects on instead
+// of being materialized as booleans
+predicate generate_condition_code(const std::vector<unsigned int> &scope_id_stack,
+                                  node *if_statement, node *condition) {
+  predicate pred;
+  if (condition->kind == UNARY_EXPRESSION_NODE && is_fused_condition(condition)) {
+    return invert_predicate(generate_condition_code(scope_id_stack, if_statement,
+                                                    condition->expression.unary.right));
+  }
+  if (condition->kind == BINARY_EXPRESSION_NODE && is_fused_condition(condition)) {
+    node *left = condition->expression.binary.left;
+    node *right = condition->expression.binary.right;
+    switch (condition->expression.binary.op) {
+    case OP_LT:
+      // left - right < 0
+      pred.selector = generate_difference_code(scope_id_stack, if_statement, left, right);
+      pred.inverted = false;
+      return pred;
+    case OP_LEQ:
+      // right - left >= 0
+      pred.selector = generate_difference_code(scope_id_stack, if_statement, right, left);
+      pred.inverted = true;
+      return pred;
+    case OP_GT:
+      // right - left < 0
+      pred.selector = generate_difference_code(scope_id_stack, if_statement, right, left);
+      pred.inverted = false;
+      return pred;
+    case OP_GEQ:
+      // left - right >= 0
+      pred.selector = generate_difference_code(scope_id_stack, if_statement, left, right);
+      pred.inverted = true;
+      return pred;
+    case OP_EQ: case OP_NEQ:
+      // The negated distance is 0 when the operands are equal and negative
+      // otherwise
+      pred.selector = ir_negate(generate_distance_code(scope_id_stack,
+                                                       get_register(scope_id_stack, if_statement),
+                                                       left, right));
+      pred.inverted = condition->expression.binary.op == OP_EQ;
+      return pred;
+    default:
+      break;
+    }
+  }
+  // Any other boolean is 1 when it is true
+  pred.selector = ir_negate(get_src(scope_id_stack, condition));
+  pred.inverted = false;
+  return pred;
 }
 
 void generate_if_statement_code(const std::vector<unsigned int> &scope_id_stack,
                                 node *if_statement) {
-  // Move the condition into the if statement's dedicated register
-  START_INSTR("MOV");
-  print_register_name(scope_id_stack, if_statement);
-  INSTR(", ");
-  print_register_name(scope_id_stack, if_statement->statement.if_else_statement.condition);
-  FINISH_INSTR();
-
-  // Find the parent if statement
-  node *parent = if_statement->parent;
-  while (parent != NULL && parent->kind != IF_STATEMENT_NODE) {
-    parent = parent->parent;
-  }
-  // And this condition with that of the parent if statement, if there is one
-  if (parent != NULL) {
-    START_INSTR("MAX");
-    print_register_name(scope_id_stack, if_statement);
-    INSTR(", ");
-    print_register_name(scope_id_stack, if_statement);
-    INSTR(", ");
-    print_register_name(scope_id_stack, parent);
-    FINISH_INSTR();
-  }
+  conditions[if_statement] =
+    generate_condition_code(scope_id_stack, if_statement,
+                            if_statement->statement.if_else_statement.condition);
 }
 
 void generate_assignment_code(const std::vector<unsigned int> &scope_id_stack,
                               node *assign) {
-  // Find the parent if statement
-  node *parent = assign->parent;
-  node *parents_child = assign;
-  while (parent != NULL && parent->kind != IF_STATEMENT_NODE) {
-    parents_child = parent;
-    parent = parent->parent;
-  }
-  if (parent != NULL) {
-    START_INSTR("CMP");
-    print_register_name(scope_id_stack, assign->statement.assignment.variable);
-    INSTR(", ");
-    print_register_name(scope_id_stack, parent);
-    INSTR(", ");
-    if (parents_child == parent->statement.if_else_statement.if_statement) {
-      // If the assignment statement is in the if statement then assign the
-      // expression when the condition is true
-      print_register_name(scope_id_stack, assign->statement.assignment.expression);
-      INSTR(", ");
-      print_register_name(scope_id_stack, assign->statement.assignment.variable);
-    } else {
-      // If the assignment statement is in the else statement then assign the
-      // expression when the condition is false
-      print_register_name(scope_id_stack, assign->statement.assignment.variable);
-      INSTR(", ");
-      print_register_name(scope_id_stack, assign->statement.assignment.expression);
+  node *variable = assign->statement.assignment.variable;
+  node *expression = assign->statement.assignment.expression;
+
+  if (!branches.empty()) {
+    // Assignments in a branch of an if statement only record where the
+    // value is held. The variable is selected from the values of both
+    // branches once the whole if statement has been generated
+    ir_dst dst = get_dst(scope_id_stack, variable);
+    ir_src src = get_src(scope_id_stack, expression);
+    for (int c = 0; c < 4; c++) {
+      if (dst.mask & (1 << c)) {
+        component_value value = { src.reg, src.swizzle[c], src.negate };
+        branches.back()[std::pair<int, int>(dst.reg, c)] = value;
+      }
     }
-    FINISH_INSTR();
-  } else {
+  } else if (!destinations.count(expression)) {
     // If the assignment statement isn't within an if or else statement
-    START_INSTR("MOV");
-    print_register_name(scope_id_stack, assign->statement.assignment.variable);
-    INSTR(", ");
-    print_register_name(scope_id_stack, assign->statement.assignment.expression);
-    FINISH_INSTR();
+    ir_emit(program, IR_MOV,
+            get_dst(scope_id_stack, variable),
+            get_src(scope_id_stack, expression));
+  }
+}
+
+// Emits instructions as if they were executed at the same time, i.e. each
+// one reads the values from before any of them. An instruction is emitted
+// before those that overwrite what it reads, and cycles are broken by
+// copying a register into a temporary
+void emit_parallel(ir_instruction_list pending) {
+  while (!pending.empty()) {
+    size_t i;
+    for (i = 0; i < pending.size(); i++) {
+      bool overwrites = false;
+      for (size_t j = 0; j < pending.size() && !overwrites; j++) {
+        for (int k = 0; j != i && k < ir_num_sources(pending[j].op); k++) {
+          if (pending[j].src[k].reg == pending[i].dst.reg &&
+              (ir_source_components(pending[j], k) & pending[i].dst.mask)) {
+            overwrites = true;
+          }
+        }
+      }
+      if (!overwrites) {
+        break;
+      }
+    }
+
+    if (i == pending.size()) {
+      // Every instruction overwrites something that another one reads
+      i = 0;
+      int copy = -1;
+      for (size_t j = 1; j < pending.size(); j++) {
+        for (int k = 0; k < ir_num_sources(pending[j].op); k++) {
+          if (pending[j].src[k].reg == pending[i].dst.reg) {
+            if (copy < 0) {
+              copy = ir_temp(program);
+              ir_emit(program, IR_MOV, ir_make_dst(copy), ir_make_src(pending[i].dst.reg));
+            }
+            pending[j].src[k].reg = copy;
+          }
+        }
+      }
+    }
+
+    ir_emit(program, pending[i].op, pending[i].dst,
+            pending[i].src[0], pending[i].src[1], pending[i].src[2]);
+    pending.erase(pending.begin() + i);
+  }
+}
+
+// Makes a source that reads the values of the entries in mask, which are
+// all held in the same register
+ir_src make_value_src(const component_value values[4], unsigned char mask) {
+  int first = 0;
+  while (!(mask & (1 << first))) {
+    first++;
+  }
+  ir_src src = ir_make_src(values[first].reg);
+  src.negate = values[first].negate;
+  bool replicated = true;
+  for (int c = 0; c < 4; c++) {
+    if (mask & (1 << c)) {
+      src.swizzle[c] = values[c].component;
+      replicated = replicated && values[c].component == values[first].component;
+    }
+  }
+  return replicated ? ir_replicate(src, first) : src;
+}
+
+// Merges the values that the branches of an if statement assign to each
+// variable with a single select. Selects of nested if statements are
+// written to temporaries that become the values assigned in the enclosing
+// branch, so nested if statements form a chain of selects
+void generate_select_code(node *if_statement) {
+  predicate pred = conditions[if_statement];
+  node *else_statement = if_statement->statement.if_else_statement.else_statement;
+
+  branch_values no_values;
+  branch_values &if_values = assigned_values[if_statement->statement.if_else_statement.if_statement];
+  branch_values &else_values = else_statement != NULL ? assigned_values[else_statement] : no_values;
+
+  // The entries of each variable that are assigned in either branch
+  std::map<int, unsigned char> assigned;
+  branch_values::iterator iter;
+  for (iter = if_values.begin(); iter != if_values.end(); iter++) {
+    assigned[iter->first.first] |= 1 << iter->first.second;
+  }
+  for (iter = else_values.begin(); iter != else_values.end(); iter++) {
+    assigned[iter->first.first] |= 1 << iter->first.second;
+  }
+
+  ir_instruction_list selects;
+  std::map<int, unsigned char>::iterator var;
+  for (var = assigned.begin(); var != assigned.end(); var++) {
+    int reg = var->first;
+    component_value if_value[4], else_value[4];
+    for (int c = 0; c < 4; c++) {
+      std::pair<int, int> key(reg, c);
+      if_value[c] = if_values.count(key) ? if_values[key] : get_current_value(reg, c);
+      else_value[c] = else_values.count(key) ? else_values[key] : get_current_value(reg, c);
+    }
+
+    // Nothing needs to be selected for entries that get the same value in
+    // both branches
+    unsigned char mask = var->second;
+    for (int c = 0; c < 4; c++) {
+      if ((mask & (1 << c)) && is_same_value(if_value[c], else_value[c])) {
+        mask &= ~(1 << c);
+        component_value current = get_current_value(reg, c);
+        if (!branches.empty()) {
+          branches.back()[std::pair<int, int>(reg, c)] = if_value[c];
+        } else if (!is_same_value(if_value[c], current)) {
+          ir_instruction move;
+          move.op = IR_MOV;
+          move.saturate = false;
+          move.dst = ir_make_dst(reg, 1 << c);
+          move.src[0] = make_value_src(if_value, 1 << c);
+          move.src[1] = move.src[2] = ir_no_src();
+          selects.push_back(move);
+        }
+      }
+    }
+
+    // Nested if statements select into a temporary
+    int dst = branches.empty() ? reg : ir_temp(program);
+
+    // One select for each group of entries whose values are held in the same
+    // registers
+    while (mask) {
+      int first = 0;
+      while (!(mask & (1 << first))) {
+        first++;
+      }
+      unsigned char group = 0;
+      for (int c = first; c < 4; c++) {
+        if ((mask & (1 << c)) &&
+            if_value[c].reg == if_value[first].reg &&
+            if_value[c].negate == if_value[first].negate &&
+            else_value[c].reg == else_value[first].reg &&
+            else_value[c].negate == else_value[first].negate) {
+          group |= 1 << c;
+        }
+      }
+      mask &= ~group;
+
+      ir_src selected = make_value_src(if_value, group);
+      ir_src unchanged = make_value_src(else_value, group);
+      ir_instruction select;
+      select.op = IR_CMP;
+      select.saturate = false;
+      select.dst = ir_make_dst(dst, group);
+      select.src[0] = pred.selector;
+      select.src[1] = pred.inverted ? unchanged : selected;
+      select.src[2] = pred.inverted ? selected : unchanged;
+      selects.push_back(select);
+
+      if (!branches.empty()) {
+        for (int c = 0; c < 4; c++) {
+          if (group & (1 << c)) {
+            component_value value = { dst, c, false };
+            branches.back()[std::pair<int, int>(reg, c)] = value;
+          }
+        }
+      }
+    }
+  }
+
+  emit_parallel(selects);
+}
+
+// Computes expression directly into variable when the instructions that
+// lower it allow it, which saves a temporary and a MOV
+void set_destination(const std::vector<unsigned int> &scope_id_stack,
+                     node *variable, node *expression) {
+  std::vector<node *> operands;
+  switch (expression->kind) {
+  case UNARY_EXPRESSION_NODE:
+    // Unary minus has no instruction that could write the variable
+    if (expression->expression.unary.op != OP_NOT) {
+      return;
+    }
+    break;
+  case BINARY_EXPRESSION_NODE:
+    switch (expression->expression.binary.op) {
+    case OP_EQ: case OP_NEQ:
+      // The distance uses the other entries of the register as well
+      return;
+    default:
+      break;
+    }
+    break;
+  case FUNCTION_NODE:
+    break;
+  case CONSTRUCTOR_NODE:
+    for (node *argument = expression->expression.constructor.arguments;
+         argument != NULL; argument = argument->argument.next_argument) {
+      operands.push_back(argument->argument.expression);
+    }
+    break;
+  default:
+    return;
   }
+
+  // Constructors write the variable one entry at a time, so they must not
+  // overwrite an entry that a later argument reads
+  int reg = get_variable_register(scope_id_stack, variable);
+  for (size_t i = 0; i < operands.size(); i++) {
+    // Unary minus is folded into the source, so -v[0] reads v itself
+    node *operand = operands[i];
+    while (operand->kind == UNARY_EXPRESSION_NODE &&
+           operand->expression.unary.op == OP_UMINUS) {
+      operand = operand->expression.unary.right;
+    }
+    if (!is_register_temporary(operand) && !is_register_constant(operand) &&
+        get_variable_register(scope_id_stack, operand) == reg) {
+      return;
+    }
+  }
+  destinations[expression] = variable;
 }
 
 void generate_unary_expr_code(const std::vector<unsigned int> &scope_id_stack,
@@ -516,29 +971,150 @@ void generate_unary_expr_code(const std::vector<unsigned int> &scope_id_stack,
 
   switch (op) {
   case OP_NOT:
-    START_INSTR("CMP");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    // true and false values are swapped here
-    INSTR(", ");
-    INSTR("FALSE");
-    INSTR(", ");
-    INSTR("TRUE");
-    FINISH_INSTR();
+    // 1 - right swaps 0 and 1
+    ir_emit(program, IR_SUB,
+            get_dst(scope_id_stack, n),
+            ir_make_src(true_register),
+            get_src(scope_id_stack, right));
     break;
   case OP_UMINUS:
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, right);
-    INSTR(", ");
-    INSTR("TRUE");
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    FINISH_INSTR();
+    // Folded into the sources that read n by get_src
+    break;
+  default:
+    break;
+  }
+}
+
+// Computes the sum of the squared differences of the entries of left and
+// right into the first entry of reg, which is only 0 when they are equal
+ir_src generate_distance_code(const std::vector<unsigned int> &scope_id_stack,
+                              int reg, node *left, node *right) {
+  symbol_type type = left->expression.expr_type;
+  int size = type & TYPE_ANY_VEC ? type & 0x7 : 1;
+
+  // The difference uses as many entries of the register as needed
+  ir_src diff = ir_make_src(reg);
+  ir_emit(program, IR_SUB,
+          ir_make_dst(reg, (1 << size) - 1),
+          get_src(scope_id_stack, left),
+          get_src(scope_id_stack, right));
+
+  switch (size) {
+  case 1:
+    ir_emit(program, IR_MUL, ir_make_dst(reg, MASK_X),
+            ir_replicate(diff, 0), ir_replicate(diff, 0));
+    break;
+  case 2:
+    // Counting the y entry twice doesn't change whether the sum is 0
+    ir_emit(program, IR_DP3, ir_make_dst(reg, MASK_X),
+            ir_swizzle(diff, 0, 1, 1, 1), ir_swizzle(diff, 0, 1, 1, 1));
+    break;
+  case 3:
+    ir_emit(program, IR_DP3, ir_make_dst(reg, MASK_X), diff, diff);
     break;
   default:
+    ir_emit(program, IR_DP4, ir_make_dst(reg, MASK_X), diff, diff);
     break;
   }
+  return ir_replicate(diff, 0);
+}
+
+// Emits the three instructions that lower == and !=: the distance between
+// the operands followed by 0 >= distance for == or 0 < distance for !=
+void generate_equality_code(const std::vector<unsigned int> &scope_id_stack,
+                            node *n, node *left, node *right, bool equal) {
+  ir_src distance = generate_distance_code(scope_id_stack,
+                                           get_register(scope_id_stack, n),
+                                           left, right);
+  ir_emit(program, equal ? IR_SGE : IR_SLT,
+          get_dst(scope_id_stack, n),
+          ir_replicate(ir_make_src(false_register), 0),
+          distance);
+}
+
+// Gets the value of a literal, which may be negated
+bool get_literal_value(node *n, float *value) {
+  if (n->kind == UNARY_EXPRESSION_NODE && n->expression.unary.op == OP_UMINUS) {
+    bool is_literal = get_literal_value(n->expression.unary.right, value);
+    *value = -*value;
+    return is_literal;
+  }
+  if (n->kind == INT_NODE) {
+    *value = n->expression.int_expr.val;
+    return true;
+  }
+  if (n->kind == FLOAT_NODE) {
+    *value = n->expression.float_expr.val;
+    return true;
+  }
+  return false;
+}
+
+// Scalar instructions read the first entry of a temporary
+ir_src get_scalar_src(int reg) {
+  return ir_replicate(ir_make_src(reg), 0);
+}
+
+// Lowers left / right. Dividing by a constant multiplies by its reciprocal,
+// which is folded at compile time unless strict numerics are requested
+void generate_division_code(ir_dst dst, ir_src left, ir_src right, node *divisor) {
+  float value;
+  if (!strictNumerics && get_literal_value(divisor, &value) && value != 0.0f) {
+    float reciprocal = 1.0f / value;
+    ir_emit(program, IR_MUL, dst, left,
+            get_scalar_src(ir_constant(program, reciprocal, reciprocal, reciprocal, reciprocal)));
+    return;
+  }
+  // The reciprocal is kept in its own temporary so that divisions by the
+  // same value share it after value numbering
+  int reciprocal = ir_temp(program);
+  ir_emit(program, IR_RCP, ir_make_dst(reciprocal, MASK_X), right);
+  ir_emit(program, IR_MUL, dst, left, get_scalar_src(reciprocal));
+}
+
+// Lowers base ^ exponent. Unless strict numerics are requested, constant
+// exponents are reduced: small integers become chains of multiplications
+// (with a reciprocal for negative ones), 0.5 becomes the reciprocal of the
+// reciprocal square root and -0.5 becomes the reciprocal square root
+void generate_power_code(ir_dst dst, ir_src base, ir_src exponent, node *exponent_node) {
+  float value;
+  if (strictNumerics || !get_literal_value(exponent_node, &value)) {
+    ir_emit(program, IR_POW, dst, base, exponent);
+    return;
+  }
+
+  // Only a float that is a small integer is converted, since converting
+  // one outside the range of int is undefined
+  bool small_power = value == floorf(value) && value >= -4 && value <= 4 && value != 0;
+  if (value == 0.5f) {
+    int root = ir_temp(program);
+    ir_emit(program, IR_RSQ, ir_make_dst(root, MASK_X), base);
+    ir_emit(program, IR_RCP, dst, get_scalar_src(root));
+  } else if (value == -0.5f) {
+    ir_emit(program, IR_RSQ, dst, base);
+  } else if (small_power) {
+    int power = (int) value;
+    int magnitude = power < 0 ? -power : power;
+    // Negative powers compute the positive power into a temporary first
+    int result = power < 0 ? ir_temp(program) : dst.reg;
+    ir_dst result_dst = power < 0 ? ir_make_dst(result, MASK_X) : dst;
+    if (magnitude == 1) {
+      ir_emit(program, IR_MOV, result_dst, base);
+    } else if (magnitude == 2) {
+      ir_emit(program, IR_MUL, result_dst, base, base);
+    } else {
+      // x^3 = x^2 * x and x^4 = x^2 * x^2
+      int square = ir_temp(program);
+      ir_emit(program, IR_MUL, ir_make_dst(square, MASK_X), base, base);
+      ir_emit(program, IR_MUL, result_dst, get_scalar_src(square),
+              magnitude == 3 ? base : get_scalar_src(square));
+    }
+    if (power < 0) {
+      ir_emit(program, IR_RCP, dst, get_scalar_src(result));
+    }
+  } else {
+    ir_emit(program, IR_POW, dst, base, exponent);
+  }
 }
 
 void generate_binary_expr_code(const std::vector<unsigned int> &scope_id_stack,
@@ -548,258 +1124,57 @@ void generate_binary_expr_code(const std::vector<unsigned int> &scope_id_stack,
   node *left = n->expression.binary.left;
   node *right = n->expression.binary.right;
 
+  ir_dst dst = get_dst(scope_id_stack, n);
+  ir_src left_src = get_src(scope_id_stack, left);
+  ir_src right_src = get_src(scope_id_stack, right);
+
   switch (op) {
   case OP_AND:
-    // Take the max of left and right - if one of them is false
-    // (0, 0, 0, 0) then that is the result
-    START_INSTR("MAX");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
+    // Take the min of left and right - if one of them is false (0) then
+    // that is the result
+    ir_emit(program, IR_MIN, dst, left_src, right_src);
     break;
   case OP_OR:
-    // Take the min of left and right - if one of them is true
-    // (-1, -1, -1, -1) then that is the result
-    START_INSTR("MIN");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
+    // Take the max of left and right - if one of them is true (1) then
+    // that is the result
+    ir_emit(program, IR_MAX, dst, left_src, right_src);
     break;
   case OP_PLUS:
-    START_INSTR("ADD");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
+    ir_emit(program, IR_ADD, dst, left_src, right_src);
     break;
   case OP_MINUS:
-    START_INSTR("SUB");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
+    ir_emit(program, IR_SUB, dst, left_src, right_src);
     break;
   case OP_DIV:
-    // Take reciprocal of the RHS
-    START_INSTR("RCP");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
-    // Multiply the result of the reciprocal by the LHS
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    FINISH_INSTR();
+    generate_division_code(dst, left_src, right_src, right);
     break;
   case OP_XOR:
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right, true);
-    FINISH_INSTR();
+    generate_power_code(dst, left_src, right_src, right);
     break;
   case OP_MUL:
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
+    ir_emit(program, IR_MUL, dst, left_src, right_src);
     break;
   case OP_LT:
     // Compare left < right
-    START_INSTR("SLT");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
-
-    // Copy the first entry into all entries
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ONE.x");
-    FINISH_INSTR();
-
-    // Multiply by TRUE to get (-1, -1, -1, -1) for true
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    INSTR(", TRUE");
-    FINISH_INSTR();
+    ir_emit(program, IR_SLT, dst, left_src, right_src);
     break;
   case OP_LEQ:
     // Compare right >= left
-    START_INSTR("SGE");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    FINISH_INSTR();
-
-    // Copy the first entry into all entries
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ONE.x");
-    FINISH_INSTR();
-
-    // Multiply by TRUE to get (-1, -1, -1, -1) for true
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    INSTR(", TRUE");
-    FINISH_INSTR();
+    ir_emit(program, IR_SGE, dst, right_src, left_src);
     break;
   case OP_GT:
     // Compare right < left
-    START_INSTR("SLT");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    FINISH_INSTR();
-
-    // Copy the first entry into all entries
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ONE.x");
-    FINISH_INSTR();
-
-    // Multiply by TRUE to get (-1, -1, -1, -1) for true
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    INSTR(", TRUE");
-    FINISH_INSTR();
+    ir_emit(program, IR_SLT, dst, right_src, left_src);
     break;
   case OP_GEQ:
     // Compare left >= right
-    START_INSTR("SGE");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
-
-    // Copy the first entry into all entries
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n, true);
-    INSTR(", ONE.x");
-    FINISH_INSTR();
-
-    // Multiply by TRUE to get (-1, -1, -1, -1) for true
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    INSTR(", TRUE");
-    FINISH_INSTR();
+    ir_emit(program, IR_SGE, dst, left_src, right_src);
     break;
   case OP_EQ:
-    // Check if left >= right
-    START_INSTR("SGE");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
-
-    // Check if right >= left
-    START_INSTR("SGE");
-    INSTR("_TEMP");
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    FINISH_INSTR();
-
-    // MUL results of previous operations
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    INSTR("_TEMP");
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    FINISH_INSTR();
-
-    // MUL by TRUE
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    INSTR("TRUE");
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    FINISH_INSTR();
+    generate_equality_code(scope_id_stack, n, left, right, true);
     break;
   case OP_NEQ:
-     // Check if left >= right
-    START_INSTR("SGE");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    FINISH_INSTR();
-
-    // Check if right >= left
-    START_INSTR("SGE");
-    INSTR("_TEMP");
-    INSTR(", ");
-    print_register_name(scope_id_stack, right);
-    INSTR(", ");
-    print_register_name(scope_id_stack, left);
-    FINISH_INSTR();
-
-    // MUL results of previous operations
-    START_INSTR("MUL");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    INSTR("_TEMP");
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    FINISH_INSTR();
-
-    // Subtract 1
-    START_INSTR("ADD");
-    print_register_name(scope_id_stack, n);
-    INSTR(", ");
-    INSTR("TRUE");
-    INSTR(", ");
-    print_register_name(scope_id_stack, n);
-    FINISH_INSTR();
+    generate_equality_code(scope_id_stack, n, left, right, false);
     break;
   default:
     break;
@@ -815,27 +1190,20 @@ void generate_function_code(const std::vector<unsigned int> &scope_id_stack,
 
   switch (func->expression.function.func_id) {
   case FUNC_DP3:
-    START_INSTR("DP3");
-    print_register_name(scope_id_stack, func);
-    INSTR(", ");
-    print_register_name(scope_id_stack, first_expr);
-    INSTR(", ");
-    print_register_name(scope_id_stack, second_expr);
-    FINISH_INSTR();
+    ir_emit(program, IR_DP3,
+            get_dst(scope_id_stack, func),
+            get_src(scope_id_stack, first_expr),
+            get_src(scope_id_stack, second_expr));
     break;
   case FUNC_RSQ:
-    START_INSTR("RSQ");
-    print_register_name(scope_id_stack, func, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, first_expr, true);
-    FINISH_INSTR();
+    ir_emit(program, IR_RSQ,
+            get_dst(scope_id_stack, func),
+            get_src(scope_id_stack, first_expr));
     break;
   case FUNC_LIT:
-    START_INSTR("LIT");
-    print_register_name(scope_id_stack, func);
-    INSTR(", ");
-    print_register_name(scope_id_stack, first_expr);
-    FINISH_INSTR();
+    ir_emit(program, IR_LIT,
+            get_dst(scope_id_stack, func),
+            get_src(scope_id_stack, first_expr));
     break;
   }
 }
@@ -843,25 +1211,19 @@ void generate_function_code(const std::vector<unsigned int> &scope_id_stack,
 void generate_constructor_code(const std::vector<unsigned int> &scope_id_stack,
                                node *constr) {
   int i = 0;
+  int reg = get_register(scope_id_stack, constr);
   node *argument = constr->expression.constructor.arguments;
+  // A scalar constructor is a copy of its argument
+  if (!(constr->expression.expr_type & TYPE_ANY_VEC)) {
+    ir_emit(program, IR_MOV,
+            get_dst(scope_id_stack, constr),
+            get_src(scope_id_stack, argument->argument.expression));
+    return;
+  }
   while (argument != NULL) {
-    START_INSTR("MOV");
-    print_register_name(scope_id_stack, constr);
-    print_index(i++);
-    INSTR(", ");
-    print_register_name(scope_id_stack, argument->argument.expression, true);
-    FINISH_INSTR();
+    ir_emit(program, IR_MOV,
+            ir_make_dst(reg, 1 << i++),
+            get_src(scope_id_stack, argument->argument.expression));
     argument = argument->argument.next_argument;
   }
-  // If this is a scalar
-  if (!(constr->expression.constructor.type->type.type & TYPE_ANY_VEC)) {
-    // Copy the first entry into all entries
-    START_INSTR("POW");
-    print_register_name(scope_id_stack, constr, true);
-    INSTR(", ");
-    print_register_name(scope_id_stack, constr, true);
-    INSTR(", ONE.x");
-    FINISH_INSTR();
-  }
 }
-
@@ -28,6 +28,12 @@
 #define MAX_TEXT       256
 #define MAX_INTEGER    32767
 
+/* Optimization levels selected with -O0, -O1, -O2 and -Os */
+#define OPTIMIZE_NONE  0
+#define OPTIMIZE_BASIC 1
+#define OPTIMIZE_FULL  2
+#define OPTIMIZE_SIZE  3
+
 /********************************************************************** 
  * External declarations for variables declared in globalvars.c.
  **********************************************************************/
@@ -44,11 +50,23 @@ extern int suppressExecution;
 extern int traceScanner;
 extern int traceParser;
 extern int traceExecution;
+extern int traceTiming;
+extern int traceTimingJSON;
+extern int traceHardware;
 
 extern int dumpSource;
 extern int dumpAST;
 extern int dumpSymbols;
 extern int dumpInstructions;
+extern int dumpStats;
+extern int dumpCost;
+extern int dumpCostJSON;
+extern int dumpPasses;
+
+extern int strictNumerics;
+extern char *targetLimits;
+extern int optimizationLevel;
+extern char *passList;
 
 
 
@@ -14,6 +14,7 @@
 
 /***********************************************************************
  * The compiler has the following parts:
+ * driver               main.c compiler467.c compiler467.h
  * global variables     globalvars.c common.h languageDef.h
  * scanner module       scanner.c
  * parser module        parser.c     parser.tab.h
@@ -22,12 +23,21 @@
  * semantics analysis   semantic.c   semantic.h
  * code generator       codegen.c    codegen.h
  **********************************************************************/
+#include <errno.h>
+#include <string.h>
+
 #include "common.h"
 
 /* Phases 3,4: Uncomment following includes as needed */
 #include "ast.h"
 #include "semantic.h"
 #include "codegen.h"
+#include "timing.h"
+#include "trace.h"
+#include "hwcounters.h"
+#include "probes.h"
+#include "symbol.h"
+#include "compiler467.h"
 
 /***********************************************************************
  * Default values for various files. Note assumption that default files
@@ -43,6 +53,7 @@
 void  getOpts   (int numargs, char **argstr);
 FILE *fileOpen  (char *fileName, char *fileMode, FILE *defaultFile);
 void  sourceDump(void);
+void  closeFiles(void);
 
 /* Phase 1: Scanner Interface. For phase 2 and after these declarations
  * are removed */
@@ -54,11 +65,14 @@ extern int   yyline;
 
 /* Phase 2: Parser Interface. Merely uncomment the following line */
 extern int yyparse(void);
+extern void scan_restart(void);
 
 /***********************************************************************
- * Main program for the Compiler
+ * Main program for the Compiler. It is called by main in main.c, and by
+ * the test runner once for every test, so everything that a compilation
+ * leaves behind is reset first.
  **********************************************************************/
-int main (int argc, char *argv[]) {
+int compiler467 (int argc, char *argv[]) {
   getOpts (argc, argv); /* Set up and apply command line options */
 
 /***********************************************************************
@@ -69,6 +83,17 @@ int main (int argc, char *argv[]) {
  * here.
  **********************************************************************/
   errorOccurred = FALSE;
+  ast = NULL;
+  scan_restart();
+  clear_symbol_tables();
+  reset_memory();
+  reset_phases();
+  if (!trace_start())
+    fprintf(errorFile, "Scanner and parser tracing was compiled out (ignored)\n");
+  if (traceHardware && !open_hardware_counters()) {
+    fprintf(errorFile, "Hardware counters are not available: %s (ignored)\n", strerror(errno));
+    traceHardware = FALSE;
+  }
 
 /***********************************************************************
  * Start the Compilation
@@ -86,11 +111,23 @@ int main (int argc, char *argv[]) {
 
 /* Phase 2: Parser -- should allocate an AST, storing the reference in the
  * global variable "ast", and build the AST there. */
-  if(1 == yyparse()) {
+  PROBE0(parse__start);
+  phase_begin(PHASE_PARSING);
+  int parse_failed = yyparse();
+  phase_end();
+  trace_flush();
+  PROBE4(parse__done, parse_failed || errorOccurred, counters.tokens, counters.nodes, counters.scopes);
+  if (1 == parse_failed) {
+    report_phases();
+    closeFiles();
     return 0; // parse failed
   }
 
+  PROBE1(semantic__start, counters.nodes);
+  phase_begin(PHASE_SEMANTIC);
   semantic_check(ast);
+  phase_end();
+  PROBE2(semantic__done, errorOccurred, counters.symbol_lookups);
 
 /* Phase 3: Call the AST dumping routine if requested */
   if (dumpAST)
@@ -99,16 +136,35 @@ int main (int argc, char *argv[]) {
 /* TODO: call your code generation routine here */
   if (errorOccurred)
     fprintf(outputFile,"Failed to compile\n");
-  else 
+  else {
+    PROBE1(codegen__start, counters.nodes);
     genCode(ast);
+    PROBE4(codegen__done, errorOccurred, counters.emitted_instructions,
+           counters.instructions, counters.temps);
+  }
 /***********************************************************************
  * Post Compilation Cleanup
  **********************************************************************/
 
 /* Make calls to any cleanup or finalization routines here. */
+  phase_begin(PHASE_CLEANUP);
   ast_free(ast);
+  phase_end();
+
+  report_phases();
+  closeFiles();
+
+  return 0;
+}
 
-  /* Clean up files if necessary */
+/***********************************************************************
+Internal Subroutines.
+***********************************************************************/
+
+/***********************************************************************
+ * Clean up files if necessary
+ **********************************************************************/
+void closeFiles (void) {
   if (inputFile != DEFAULT_INPUT_FILE)
     fclose (inputFile);
   if (errorFile != DEFAULT_ERROR_FILE)
@@ -121,14 +177,8 @@ int main (int argc, char *argv[]) {
     fclose (outputFile);
   if (runInputFile != DEFAULT_RUN_INPUT_FILE)
     fclose (runInputFile);
-
-  return 0;
 }
 
-/***********************************************************************
-Internal Subroutines.
-***********************************************************************/
-
 /***********************************************************************
 Subroutines for reading command line input and initializing IO files.
 ***********************************************************************/
@@ -152,11 +202,23 @@ void getOpts (int numargs, char **argstr) {
   traceScanner      = FALSE;
   traceParser       = FALSE;
   traceExecution    = FALSE;
+  traceTiming       = FALSE;
+  traceTimingJSON   = FALSE;
+  traceHardware     = FALSE;
 
   dumpSource        = FALSE;
   dumpAST           = FALSE;
   dumpSymbols       = FALSE;
   dumpInstructions  = FALSE;
+  dumpStats         = FALSE;
+  dumpCost          = FALSE;
+  dumpCostJSON      = FALSE;
+  dumpPasses        = FALSE;
+
+  strictNumerics    = FALSE;
+  targetLimits      = NULL;
+  optimizationLevel = OPTIMIZE_FULL;
+  passList          = NULL;
 
   /* Process command line input */
   for (i=1; i<numargs; i++) {
@@ -164,11 +226,15 @@ void getOpts (int numargs, char **argstr) {
     if (optarg[0] == '-') { /* Compiler option */
       subarg = optarg + 2;
       switch (optarg[1]) {
-        case 'D': /* Dump options -Dasxy */
+        case 'D': /* Dump options -Dacjopsxy */
           optch = *(subarg++);
           while (optch) {
             switch (optch) {
               case 'a': dumpAST          = TRUE; break;
+              case 'c': dumpCost         = TRUE; break;
+              case 'j': dumpCostJSON     = TRUE; break;
+              case 'o': dumpStats        = TRUE; break;
+              case 'p': dumpPasses       = TRUE; break;
               case 's': dumpSource       = TRUE; break;
               case 'x': dumpInstructions = TRUE; break;
               case 'y': dumpSymbols      = TRUE; break;
@@ -177,27 +243,41 @@ void getOpts (int numargs, char **argstr) {
             optch = *(subarg++);
           }
           break;
-        case 'T': /* Trace options -Tnpx */
+        case 'T': /* Trace options -Thjnptx */
           optch = *(subarg++);
           while (optch) {
             switch (optch) {
+              case 'h': traceHardware  = TRUE; break;
+              case 'j': traceTimingJSON = TRUE; break;
               case 'n': traceScanner   = TRUE; break;
               case 'p': traceParser    = TRUE; break;
+              case 't': traceTiming    = TRUE; break;
               case 'x': traceExecution = TRUE; break;
               default: fprintf(errorFile, "Invalid trace option %c ignored\n", optch); break;
             }
             optch = *(subarg++);
           }
           break;
-        case 'O': /* Alternative output file */
-          printf("Blaaaaa\n");
-          if (optarg[2] == 0) {
+        case 'O': /* Optimization level -O0, -O1, -O2, -Os or alternative output file */
+          if (optarg[2] != 0 && optarg[3] == 0 && strchr("012s", optarg[2]) != NULL) {
+            switch (optarg[2]) {
+              case '0': optimizationLevel = OPTIMIZE_NONE;  break;
+              case '1': optimizationLevel = OPTIMIZE_BASIC; break;
+              case '2': optimizationLevel = OPTIMIZE_FULL;  break;
+              case 's': optimizationLevel = OPTIMIZE_SIZE;  break;
+            }
+          } else if (optarg[2] == 0) {
             i += 1;
             outputFile = fileOpen (argstr[i], "w", DEFAULT_OUTPUT_FILE);
-          printf("%s\n",argstr[i]);
           } else
             outputFile = fileOpen (&optarg[2], "w", DEFAULT_OUTPUT_FILE);
-          printf("%s\n",&optarg[2]);
+          break;
+        case 'P': /* Passes to enable or disable */
+          if (optarg[2] == 0) {
+            i += 1;
+            passList = argstr[i];
+          } else
+            passList = &optarg[2];
           break;
         case 'E': /* Alternative error message file */
           if (optarg[2] == 0) {
@@ -230,6 +310,16 @@ void getOpts (int numargs, char **argstr) {
         case 'X': /* supress execution flag */
           suppressExecution = TRUE;
           break;
+        case 'S': /* strict numerics flag */
+          strictNumerics = TRUE;
+          break;
+        case 'L': /* Limits of the target */
+          if (optarg[2] == 0) {
+            i += 1;
+            targetLimits = argstr[i];
+          } else
+            targetLimits = &optarg[2];
+          break;
         default: /* Anything else */
           fprintf(stderr,"Unknown option character %c (ignored)\n", optch);
           break;
@@ -0,0 +1,8 @@
+#ifndef _COMPILER467_H
+#define _COMPILER467_H
+
+// Compile the program with the command line arguments, which is all that
+// main does. Every call is a separate compilation
+int compiler467(int argc, char *argv[]);
+
+#endif
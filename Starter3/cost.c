@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "cost.h"
+
+/****** COST MODEL ******/
+/*
+ * A static estimate of how expensive a program is, to compare the output of
+ * different compiler versions before it reaches a driver. Every instruction
+ * is assumed to issue in one cycle, except for the ones that are evaluated
+ * as a series of scalar operations by most hardware:
+ *   - RCP, RSQ, EX2 and LG2 are computed by a separate transcendental unit
+ *   - POW is LG2, MUL and EX2
+ *   - LIT is a MAX, a POW and a compare
+ * The weights only have to be right relative to each other.
+ */
+
+static int opcode_cycles(ir_opcode op) {
+  switch (op) {
+  case IR_RCP: case IR_RSQ: case IR_EX2: case IR_LG2:
+    return 2;
+  case IR_POW:
+    return 5;
+  case IR_LIT:
+    return 6;
+  default:
+    return 1;
+  }
+}
+
+bool is_expensive_opcode(ir_opcode op) {
+  switch (op) {
+  case IR_POW: case IR_LG2: case IR_EX2: case IR_RSQ: case IR_RCP:
+    return true;
+  default:
+    return false;
+  }
+}
+
+program_cost ir_cost(const ir_program &prog) {
+  program_cost cost;
+  memset(&cost, 0, sizeof(cost));
+
+  std::vector<bool> used(prog.registers.size(), false);
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    cost.instructions++;
+    cost.alu++;
+    cost.expensive += is_expensive_opcode(instr.op);
+    cost.cycles += opcode_cycles(instr.op);
+    cost.opcodes[instr.op]++;
+
+    used[instr.dst.reg] = true;
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      used[instr.src[j].reg] = true;
+    }
+  }
+
+  // Only referenced registers are declared
+  for (size_t i = 0; i < prog.registers.size(); i++) {
+    const ir_register &reg = prog.registers[i];
+    if (!used[i]) {
+      continue;
+    }
+    switch (reg.kind) {
+    case REGISTER_TEMP: case REGISTER_VARIABLE:
+      cost.temps++;
+      break;
+    case REGISTER_CONSTANT:
+      cost.params++;
+      break;
+    case REGISTER_BUILTIN:
+      if (reg.name.compare(0, 9, "fragment.") == 0) {
+        cost.attribs++;
+      } else if (reg.name.compare(0, 7, "result.") != 0) {
+        cost.params++;
+      }
+      break;
+    }
+  }
+  return cost;
+}
+
+void print_cost(FILE *f, const program_cost &cost) {
+  fprintf(f, "instructions: %d (%d ALU, %d texture, %d expensive)\n",
+          cost.instructions, cost.alu, cost.texture, cost.expensive);
+  fprintf(f, "estimated cycles: %d\n", cost.cycles);
+  fprintf(f, "TEMPs: %d, PARAMs: %d, attributes: %d\n", cost.temps, cost.params, cost.attribs);
+  for (int op = 0; op < NUM_OPCODES; op++) {
+    if (cost.opcodes[op] > 0) {
+      fprintf(f, "  %-4s %4d x %d cycles\n", ir_opcode_name((ir_opcode) op),
+              cost.opcodes[op], opcode_cycles((ir_opcode) op));
+    }
+  }
+}
+
+void print_cost_json(FILE *f, const program_cost &cost) {
+  fprintf(f, "{\"instructions\": %d, \"alu\": %d, \"texture\": %d, \"expensive\": %d, "
+             "\"cycles\": %d, \"temps\": %d, \"params\": %d, \"attribs\": %d, \"opcodes\": {",
+          cost.instructions, cost.alu, cost.texture, cost.expensive,
+          cost.cycles, cost.temps, cost.params, cost.attribs);
+  bool first = true;
+  for (int op = 0; op < NUM_OPCODES; op++) {
+    if (cost.opcodes[op] > 0) {
+      fprintf(f, "%s\"%s\": %d", first ? "" : ", ", ir_opcode_name((ir_opcode) op), cost.opcodes[op]);
+      first = false;
+    }
+  }
+  fprintf(f, "}}\n");
+}
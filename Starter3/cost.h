@@ -0,0 +1,36 @@
+#ifndef _COST_H
+#define _COST_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+// IR_SUB is the last opcode
+#define NUM_OPCODES (IR_SUB + 1)
+
+typedef struct {
+  int instructions;
+  int alu;        // Arithmetic instructions
+  int texture;    // Texture lookups, which miniGLSL can't express yet
+  int expensive;  // POW, LG2, EX2, RSQ and RCP
+  int cycles;     // Estimated with the weights in cost.c
+
+  // Declared or referenced resources
+  int temps;
+  int params;     // PARAM constants and program/state parameters
+  int attribs;    // fragment.* attributes
+
+  int opcodes[NUM_OPCODES];
+} program_cost;
+
+// Checks if op is computed by the slower transcendental unit
+bool is_expensive_opcode(ir_opcode op);
+
+// Estimate the cost of running the program once per fragment
+program_cost ir_cost(const ir_program &prog);
+
+// Print the cost as a readable report, or as one line of JSON
+void print_cost(FILE *f, const program_cost &cost);
+void print_cost_json(FILE *f, const program_cost &cost);
+
+#endif
@@ -36,11 +36,23 @@ int suppressExecution;
 int traceScanner;
 int traceParser;
 int traceExecution;
+int traceTiming;
+int traceTimingJSON;
+int traceHardware;
 
 int dumpSource;
 int dumpAST;
 int dumpSymbols;
 int dumpInstructions;
+int dumpStats;
+int dumpCost;
+int dumpCostJSON;
+int dumpPasses;
+
+int strictNumerics;
+char *targetLimits;
+int optimizationLevel;
+char *passList;
 
 /***********************************************************************
  * Scanner/Parser/AST/Semantics global variables.
@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <string.h>
+
+#include "hwcounters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/****** HARDWARE COUNTERS ******/
+/*
+ * The events are opened with perf_event_open in small groups of events
+ * that are compared with each other, so that each group is scheduled as a
+ * whole and read with a single read at every phase boundary:
+ *   - cycles and instructions
+ *   - the cache misses
+ *   - the branches and branch misses
+ * The first event of a group that opens leads it. Only user space is
+ * counted, so the reads themselves are not.
+ *
+ * Processors have few counters, so the kernel takes turns between the
+ * groups. Every read returns how long the group was enabled and how long
+ * it actually ran, and the count of a phase is scaled up by those times
+ * over the phase, since the whole run's ratio says nothing about a single
+ * phase.
+ */
+
+static const int NUM_GROUPS = 3;
+static const int groups[NUM_HW_COUNTERS] = { 0, 0, 1, 1, 2, 2 };
+
+static int fds[NUM_HW_COUNTERS] = { -1, -1, -1, -1, -1, -1 };
+// Where every event is in a read of its group
+static int slots[NUM_HW_COUNTERS];
+// The event that leads every group
+static int leaders[NUM_GROUPS] = { -1, -1, -1 };
+static int group_sizes[NUM_GROUPS];
+static bool opened;
+
+#ifdef __linux__
+
+static const struct {
+  __u32 type;
+  __u64 config;
+} events[NUM_HW_COUNTERS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+bool open_hardware_counters(void) {
+  if (opened) {
+    return true;
+  }
+
+  int error = ENOSYS;
+  for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+    int &leader = leaders[groups[c]];
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.disabled = leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader < 0 ? -1 : fds[leader], 0);
+    if (fd < 0) {
+      error = errno;
+      continue;
+    }
+    fds[c] = fd;
+    slots[c] = group_sizes[groups[c]]++;
+    if (leader < 0) {
+      leader = c;
+    }
+  }
+
+  for (int g = 0; g < NUM_GROUPS; g++) {
+    if (leaders[g] >= 0) {
+      ioctl(fds[leaders[g]], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      opened = true;
+    }
+  }
+  if (!opened) {
+    errno = error;
+  }
+  return opened;
+}
+
+bool read_hardware_counters(hardware_reading readings[NUM_HW_COUNTERS]) {
+  memset(readings, 0, NUM_HW_COUNTERS * sizeof(hardware_reading));
+  bool ok = opened;
+  for (int g = 0; g < NUM_GROUPS; g++) {
+    // The number of events, the enabled and running times, then the counts
+    __u64 data[3 + NUM_HW_COUNTERS];
+    if (leaders[g] < 0) {
+      continue;
+    }
+    if (read(fds[leaders[g]], data, sizeof(data)) <= 0 || data[2] == 0) {
+      ok = false;
+      continue;
+    }
+    for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+      if (groups[c] == g && fds[c] >= 0) {
+        readings[c].count = data[3 + slots[c]];
+        readings[c].enabled = data[1];
+        readings[c].running = data[2];
+      }
+    }
+  }
+  return ok;
+}
+
+#else
+
+bool open_hardware_counters(void) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool read_hardware_counters(hardware_reading readings[NUM_HW_COUNTERS]) {
+  memset(readings, 0, NUM_HW_COUNTERS * sizeof(hardware_reading));
+  return false;
+}
+
+#endif
+
+double hardware_count_between(const hardware_reading &before, const hardware_reading &after) {
+  double running = after.running - before.running;
+  if (running <= 0) {
+    return 0;
+  }
+  return (after.count - before.count) * (after.enabled - before.enabled) / running;
+}
+
+bool has_hardware_counter(hardware_counter counter) {
+  return fds[counter] >= 0;
+}
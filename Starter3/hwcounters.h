@@ -0,0 +1,39 @@
+#ifndef _HWCOUNTERS_H
+#define _HWCOUNTERS_H
+
+// The hardware events that are counted for every phase with -Th
+typedef enum {
+  HW_CYCLES,
+  HW_INSTRUCTIONS,
+  HW_L1D_MISSES,     // L1 data cache read misses
+  HW_LLC_MISSES,     // Last level cache misses
+  HW_BRANCHES,
+  HW_BRANCH_MISSES,
+  NUM_HW_COUNTERS
+} hardware_counter;
+
+// Start counting the events of the compiling thread in user space. Events
+// that the processor or the kernel doesn't support are left out. Returns
+// false with errno set if none of them can be counted
+bool open_hardware_counters(void);
+
+// Whether the event is being counted
+bool has_hardware_counter(hardware_counter counter);
+
+// A raw count, with how long the event was enabled and how long it was
+// actually counted, in nanoseconds since the counters were opened
+typedef struct {
+  double count;
+  double enabled;
+  double running;
+} hardware_reading;
+
+// Read every event. Returns false if the kernel hasn't been able to
+// schedule some of them at all
+bool read_hardware_counters(hardware_reading readings[NUM_HW_COUNTERS]);
+
+// The number of events between two readings, scaled up by how long the
+// event was enabled over how long it was counted in between
+double hardware_count_between(const hardware_reading &before, const hardware_reading &after);
+
+#endif
@@ -0,0 +1,292 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "ir.h"
+
+/****** BUILDING ******/
+void ir_clear(ir_program &prog) {
+  prog.registers.clear();
+  prog.instructions.clear();
+  prog.num_temps = 0;
+  prog.num_constants = 0;
+  prog.constants.clear();
+}
+
+int ir_add_register(ir_program &prog, register_kind kind, const std::string &name) {
+  ir_register reg;
+  reg.kind = kind;
+  reg.name = name;
+  reg.value[0] = reg.value[1] = reg.value[2] = reg.value[3] = 0;
+  reg.write_only = false;
+  prog.registers.push_back(reg);
+  return prog.registers.size() - 1;
+}
+
+int ir_temp(ir_program &prog) {
+  // Number the temporaries in the order that they are created
+  char name[32];
+  snprintf(name, sizeof(name), "tempVar%d", prog.num_temps++);
+  return ir_add_register(prog, REGISTER_TEMP, name);
+}
+
+int ir_constant(ir_program &prog, float x, float y, float z, float w) {
+  // Reuse an existing PARAM with the same value, if there is one
+  std::vector<float> value(4);
+  value[0] = x; value[1] = y; value[2] = z; value[3] = w;
+  std::map<std::vector<float>, int>::iterator iter = prog.constants.find(value);
+  if (iter != prog.constants.end()) {
+    return iter->second;
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "const%d", prog.num_constants++);
+  int reg = ir_constant(prog, name, x, y, z, w);
+  prog.constants[value] = reg;
+  return reg;
+}
+
+int ir_constant(ir_program &prog, const std::string &name, float x, float y, float z, float w) {
+  int reg = ir_add_register(prog, REGISTER_CONSTANT, name);
+  prog.registers[reg].value[0] = x;
+  prog.registers[reg].value[1] = y;
+  prog.registers[reg].value[2] = z;
+  prog.registers[reg].value[3] = w;
+  return reg;
+}
+
+ir_dst ir_make_dst(int reg, unsigned char mask) {
+  ir_dst dst;
+  dst.reg = reg;
+  dst.mask = mask;
+  return dst;
+}
+
+ir_src ir_make_src(int reg) {
+  ir_src src;
+  src.reg = reg;
+  src.swizzle[0] = 0;
+  src.swizzle[1] = 1;
+  src.swizzle[2] = 2;
+  src.swizzle[3] = 3;
+  src.negate = false;
+  return src;
+}
+
+ir_src ir_no_src() {
+  return ir_make_src(-1);
+}
+
+ir_src ir_swizzle(ir_src src, int x, int y, int z, int w) {
+  // Compose the new swizzle with the existing one
+  unsigned char swizzle[4] = { src.swizzle[x], src.swizzle[y], src.swizzle[z], src.swizzle[w] };
+  for (int i = 0; i < 4; i++) {
+    src.swizzle[i] = swizzle[i];
+  }
+  return src;
+}
+
+ir_src ir_replicate(ir_src src, int component) {
+  return ir_swizzle(src, component, component, component, component);
+}
+
+ir_src ir_negate(ir_src src) {
+  src.negate = !src.negate;
+  return src;
+}
+
+void ir_emit(ir_program &prog, ir_opcode op, ir_dst dst, ir_src a, ir_src b, ir_src c) {
+  ir_instruction instr;
+  instr.op = op;
+  instr.saturate = false;
+  instr.dst = dst;
+  instr.src[0] = a;
+  instr.src[1] = b;
+  instr.src[2] = c;
+  prog.instructions.push_back(instr);
+}
+
+/****** QUERIES ******/
+int ir_num_sources(ir_opcode op) {
+  switch (op) {
+  case IR_ABS: case IR_EX2: case IR_LG2: case IR_LIT:
+  case IR_MOV: case IR_RCP: case IR_RSQ:
+    return 1;
+  case IR_ADD: case IR_DP3: case IR_DP4: case IR_MAX: case IR_MIN:
+  case IR_MUL: case IR_POW: case IR_SGE: case IR_SLT: case IR_SUB:
+    return 2;
+  case IR_CMP: case IR_MAD:
+    return 3;
+  }
+  return 0;
+}
+
+ir_opcode_class ir_get_class(ir_opcode op) {
+  switch (op) {
+  case IR_EX2: case IR_LG2: case IR_POW: case IR_RCP: case IR_RSQ:
+    return CLASS_SCALAR;
+  case IR_DP3:
+    return CLASS_DOT3;
+  case IR_DP4:
+    return CLASS_DOT4;
+  case IR_LIT:
+    return CLASS_LIT;
+  default:
+    return CLASS_COMPONENTWISE;
+  }
+}
+
+const char *ir_opcode_name(ir_opcode op) {
+  switch (op) {
+  case IR_ABS: return "ABS";
+  case IR_ADD: return "ADD";
+  case IR_CMP: return "CMP";
+  case IR_DP3: return "DP3";
+  case IR_DP4: return "DP4";
+  case IR_EX2: return "EX2";
+  case IR_LG2: return "LG2";
+  case IR_LIT: return "LIT";
+  case IR_MAD: return "MAD";
+  case IR_MAX: return "MAX";
+  case IR_MIN: return "MIN";
+  case IR_MOV: return "MOV";
+  case IR_MUL: return "MUL";
+  case IR_POW: return "POW";
+  case IR_RCP: return "RCP";
+  case IR_RSQ: return "RSQ";
+  case IR_SGE: return "SGE";
+  case IR_SLT: return "SLT";
+  case IR_SUB: return "SUB";
+  }
+  return "unknown";
+}
+
+// Returns the swizzle positions that are read from every source
+unsigned char ir_source_positions(const ir_instruction &instr) {
+  switch (ir_get_class(instr.op)) {
+  case CLASS_COMPONENTWISE: return instr.dst.mask;
+  case CLASS_SCALAR:        return MASK_X;
+  case CLASS_DOT3:          return MASK_X | MASK_Y | MASK_Z;
+  case CLASS_DOT4:          return MASK_XYZW;
+  case CLASS_LIT:           return MASK_X | MASK_Y | MASK_W;
+  }
+  return MASK_XYZW;
+}
+
+// Returns the register components that are read by source i
+unsigned char ir_source_components(const ir_instruction &instr, int i) {
+  unsigned char positions = ir_source_positions(instr);
+  unsigned char components = 0;
+  for (int c = 0; c < 4; c++) {
+    if (positions & (1 << c)) {
+      components |= 1 << instr.src[i].swizzle[c];
+    }
+  }
+  return components;
+}
+
+bool ir_reads_register(const ir_instruction &instr, int reg) {
+  for (int i = 0; i < ir_num_sources(instr.op); i++) {
+    if (instr.src[i].reg == reg) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/****** PRINTING ******/
+static const char component_names[] = "xyzw";
+
+// Values that six decimals can't hold, like folded reciprocals, are
+// printed with the nine significant digits that read back as the same float
+static void print_value(FILE *f, float value) {
+  char text[32];
+  if (value == floorf(value) && fabsf(value) < 1e9) {
+    fprintf(f, "%d", (int) value);
+    return;
+  }
+  snprintf(text, sizeof(text), "%f", value);
+  if (strtof(text, NULL) != value) {
+    snprintf(text, sizeof(text), "%.9g", value);
+  }
+  fprintf(f, "%s", text);
+}
+
+static void print_dst(FILE *f, const ir_program &prog, const ir_dst &dst) {
+  fprintf(f, "%s", prog.registers[dst.reg].name.c_str());
+  if (dst.mask != MASK_XYZW) {
+    fprintf(f, ".");
+    for (int c = 0; c < 4; c++) {
+      if (dst.mask & (1 << c)) {
+        fprintf(f, "%c", component_names[c]);
+      }
+    }
+  }
+}
+
+static void print_src(FILE *f, const ir_program &prog, const ir_src &src) {
+  fprintf(f, "%s%s", src.negate ? "-" : "", prog.registers[src.reg].name.c_str());
+
+  const unsigned char *s = src.swizzle;
+  if (s[0] == s[1] && s[1] == s[2] && s[2] == s[3]) {
+    // Replicate a single component
+    fprintf(f, ".%c", component_names[s[0]]);
+  } else if (s[0] != 0 || s[1] != 1 || s[2] != 2 || s[3] != 3) {
+    fprintf(f, ".%c%c%c%c",
+            component_names[s[0]], component_names[s[1]],
+            component_names[s[2]], component_names[s[3]]);
+  }
+}
+
+void ir_print_instruction(FILE *f, const ir_program &prog, const ir_instruction &instr) {
+  fprintf(f, "%s%s ", ir_opcode_name(instr.op), instr.saturate ? "_SAT" : "");
+  print_dst(f, prog, instr.dst);
+  for (int i = 0; i < ir_num_sources(instr.op); i++) {
+    fprintf(f, ", ");
+    print_src(f, prog, instr.src[i]);
+  }
+  fprintf(f, ";\n");
+}
+
+void ir_print(FILE *f, const ir_program &prog) {
+  // Only declare the registers that are actually referenced
+  std::vector<bool> used(prog.registers.size(), false);
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    used[instr.dst.reg] = true;
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      used[instr.src[j].reg] = true;
+    }
+  }
+
+  fprintf(f, "!!ARBfp1.0\n");
+
+  for (size_t i = 0; i < prog.registers.size(); i++) {
+    const ir_register &reg = prog.registers[i];
+    if (!used[i]) {
+      continue;
+    }
+    if (reg.kind == REGISTER_CONSTANT) {
+      fprintf(f, "PARAM %s = ", reg.name.c_str());
+      if (reg.value[0] == reg.value[1] &&
+          reg.value[1] == reg.value[2] &&
+          reg.value[2] == reg.value[3]) {
+        print_value(f, reg.value[0]);
+      } else {
+        fprintf(f, "{ ");
+        for (int c = 0; c < 4; c++) {
+          print_value(f, reg.value[c]);
+          fprintf(f, c < 3 ? ", " : " }");
+        }
+      }
+      fprintf(f, ";\n");
+    } else if (reg.kind == REGISTER_TEMP || reg.kind == REGISTER_VARIABLE) {
+      fprintf(f, "TEMP %s;\n", reg.name.c_str());
+    }
+  }
+
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    ir_print_instruction(f, prog, prog.instructions[i]);
+  }
+
+  fprintf(f, "END\n");
+}
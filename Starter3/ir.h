@@ -0,0 +1,136 @@
+#ifndef _IR_H
+#define _IR_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "accounting.h"
+
+// ARB fragment program instructions emitted by the code generator
+typedef enum {
+  IR_ABS,
+  IR_ADD,
+  IR_CMP,
+  IR_DP3,
+  IR_DP4,
+  IR_EX2,
+  IR_LG2,
+  IR_LIT,
+  IR_MAD,
+  IR_MAX,
+  IR_MIN,
+  IR_MOV,
+  IR_MUL,
+  IR_POW,
+  IR_RCP,
+  IR_RSQ,
+  IR_SGE,
+  IR_SLT,
+  IR_SUB,
+} ir_opcode;
+
+/*
+ * Describes how the components of the destination depend on the
+ * components of the sources:
+ *   CLASS_COMPONENTWISE  dst.c depends on component c of each source
+ *   CLASS_SCALAR         every dst component is a function of src.x
+ *   CLASS_DOT3/DOT4      every dst component is a dot product
+ *   CLASS_LIT            dst.c depends on src.x, src.y and src.w
+ */
+typedef enum {
+  CLASS_COMPONENTWISE,
+  CLASS_SCALAR,
+  CLASS_DOT3,
+  CLASS_DOT4,
+  CLASS_LIT,
+} ir_opcode_class;
+
+typedef enum {
+  REGISTER_TEMP,     // Intermediate value created by the code generator
+  REGISTER_VARIABLE, // A variable declared in the shader
+  REGISTER_CONSTANT, // PARAM holding a literal value
+  REGISTER_BUILTIN,  // Predefined attribute, parameter or result binding
+} register_kind;
+
+// Write mask bits
+#define MASK_X    (1 << 0)
+#define MASK_Y    (1 << 1)
+#define MASK_Z    (1 << 2)
+#define MASK_W    (1 << 3)
+#define MASK_XYZW (MASK_X | MASK_Y | MASK_Z | MASK_W)
+
+typedef struct {
+  register_kind kind;
+  std::string name;
+
+  // Only meaningful for REGISTER_CONSTANT
+  float value[4];
+
+  // Result bindings cannot be read from
+  bool write_only;
+} ir_register;
+
+typedef struct {
+  int reg;
+  unsigned char mask;
+} ir_dst;
+
+typedef struct {
+  int reg; // -1 if the source is unused
+  unsigned char swizzle[4];
+  bool negate;
+} ir_src;
+
+typedef struct {
+  ir_opcode op;
+  bool saturate;
+  ir_dst dst;
+  ir_src src[3];
+} ir_instruction;
+
+typedef std::vector<ir_register, tracked_allocator<ir_register, MEMORY_IR> > ir_register_list;
+typedef std::vector<ir_instruction, tracked_allocator<ir_instruction, MEMORY_IR> > ir_instruction_list;
+
+typedef struct {
+  ir_register_list registers;
+  ir_instruction_list instructions;
+
+  // Used for naming temporaries and sharing PARAMs with the same value
+  int num_temps;
+  int num_constants;
+  std::map<std::vector<float>, int> constants;
+} ir_program;
+
+/****** BUILDING ******/
+void ir_clear(ir_program &prog);
+int ir_add_register(ir_program &prog, register_kind kind, const std::string &name);
+int ir_temp(ir_program &prog);
+int ir_constant(ir_program &prog, float x, float y, float z, float w);
+int ir_constant(ir_program &prog, const std::string &name, float x, float y, float z, float w);
+
+ir_dst ir_make_dst(int reg, unsigned char mask = MASK_XYZW);
+ir_src ir_make_src(int reg);
+ir_src ir_no_src();
+ir_src ir_swizzle(ir_src src, int x, int y, int z, int w);
+ir_src ir_replicate(ir_src src, int component);
+ir_src ir_negate(ir_src src);
+
+void ir_emit(ir_program &prog, ir_opcode op, ir_dst dst,
+             ir_src a, ir_src b = ir_no_src(), ir_src c = ir_no_src());
+
+/****** QUERIES ******/
+int ir_num_sources(ir_opcode op);
+ir_opcode_class ir_get_class(ir_opcode op);
+const char *ir_opcode_name(ir_opcode op);
+
+unsigned char ir_source_positions(const ir_instruction &instr);
+unsigned char ir_source_components(const ir_instruction &instr, int i);
+bool ir_reads_register(const ir_instruction &instr, int reg);
+
+/****** PRINTING ******/
+void ir_print(FILE *f, const ir_program &prog);
+void ir_print_instruction(FILE *f, const ir_program &prog, const ir_instruction &instr);
+
+#endif
@@ -0,0 +1,11 @@
+/***********************************************************************
+ * main.c
+ *
+ * Entry point of the compiler. The compiler itself is in compiler467.c,
+ * so that the test runner can link it with its own main.
+ **********************************************************************/
+#include "compiler467.h"
+
+int main (int argc, char *argv[]) {
+  return compiler467(argc, argv);
+}
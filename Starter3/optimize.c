@@ -0,0 +1,1453 @@
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "optimize.h"
+
+/****** VALUE NUMBERING ******/
+/*
+ * Since every if statement is converted into conditional moves, the
+ * generated program is a single basic block and value numbering over it
+ * covers the whole shader.
+ *
+ * Every register component is given the number of the value that it holds.
+ * A value is identified by the instruction that computes it together with
+ * the values of the components that the instruction reads, so:
+ *   - writing a variable (including the CMP emitted for an assignment under
+ *     an if statement) gives it a new value and invalidates earlier
+ *     computations that were based on the old one
+ *   - the if condition is just another source of the CMP, so the same
+ *     computation in both branches of an if is still recognized
+ *
+ * An instruction is eliminated if its destination already holds the
+ * values it computes, or if its destination is a temporary that is only
+ * written once and the values are available in some other register that
+ * isn't overwritten before the temporary's last use. In that case the
+ * temporary's uses are redirected to the other register.
+ */
+
+// Tags that distinguish values that don't come from an instruction
+enum {
+  KEY_INITIAL = -1,  // Value of a register before it is first written
+  KEY_CONSTANT = -2, // A literal value held in a PARAM
+  KEY_NEGATE = -3,   // Negation of another value
+};
+
+typedef std::vector<int> value_key;
+typedef std::pair<int, int> location; // register, component
+
+typedef struct {
+  int reg;
+  unsigned char components[4];
+} rename_info;
+
+typedef struct {
+  const ir_program *prog;
+
+  // Value numbers of every distinct computation
+  std::map<value_key, int> values;
+  int num_values;
+
+  // The value held by every register component, -1 if it isn't known yet
+  std::vector<int> current;
+
+  // The register components that currently hold every value
+  std::map<int, std::set<location> > locations;
+
+  // Value numbers of negated values
+  std::map<int, int> negations;
+} value_table;
+
+static int lookup_value(value_table &vt, const value_key &key) {
+  std::map<value_key, int>::iterator iter = vt.values.find(key);
+  if (iter != vt.values.end()) {
+    return iter->second;
+  }
+  vt.values[key] = vt.num_values;
+  return vt.num_values++;
+}
+
+static void set_value(value_table &vt, int reg, int comp, int value) {
+  int &cur = vt.current[reg * 4 + comp];
+  if (cur >= 0) {
+    vt.locations[cur].erase(location(reg, comp));
+  }
+  cur = value;
+  vt.locations[value].insert(location(reg, comp));
+}
+
+static int get_value(value_table &vt, int reg, int comp) {
+  if (vt.current[reg * 4 + comp] < 0) {
+    const ir_register &r = vt.prog->registers[reg];
+    value_key key;
+    if (r.kind == REGISTER_CONSTANT) {
+      // PARAMs with the same value hold the same value number
+      int bits;
+      memcpy(&bits, &r.value[comp], sizeof(bits));
+      key.push_back(KEY_CONSTANT);
+      key.push_back(bits);
+    } else {
+      key.push_back(KEY_INITIAL);
+      key.push_back(reg);
+      key.push_back(comp);
+    }
+    set_value(vt, reg, comp, lookup_value(vt, key));
+  }
+  return vt.current[reg * 4 + comp];
+}
+
+static int negate_value(value_table &vt, int value) {
+  std::map<int, int>::iterator iter = vt.negations.find(value);
+  if (iter != vt.negations.end()) {
+    return iter->second;
+  }
+  value_key key;
+  key.push_back(KEY_NEGATE);
+  key.push_back(value);
+  int negated = lookup_value(vt, key);
+  vt.negations[value] = negated;
+  vt.negations[negated] = value;
+  return negated;
+}
+
+static int source_value(value_table &vt, const ir_src &src, int position) {
+  int value = get_value(vt, src.reg, src.swizzle[position]);
+  return src.negate ? negate_value(vt, value) : value;
+}
+
+static bool is_commutative(ir_opcode op) {
+  switch (op) {
+  case IR_ADD: case IR_MUL: case IR_MAX: case IR_MIN: case IR_MAD:
+  case IR_DP3: case IR_DP4:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Checks if both values that a CMP selects between are the same in every
+// component that it writes
+static bool selects_equal_values(value_table &vt, const ir_instruction &instr) {
+  for (int c = 0; c < 4; c++) {
+    if ((instr.dst.mask & (1 << c)) &&
+        source_value(vt, instr.src[1], c) != source_value(vt, instr.src[2], c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Compute the value that instr writes into component c of its destination
+static int instruction_value(value_table &vt, const ir_instruction &instr, int c) {
+  int num_sources = ir_num_sources(instr.op);
+  ir_opcode_class op_class = ir_get_class(instr.op);
+
+  // A plain move copies the value
+  if (instr.op == IR_MOV && !instr.saturate) {
+    return source_value(vt, instr.src[0], c);
+  }
+
+  value_key key;
+  key.push_back(instr.op);
+  key.push_back(instr.saturate);
+
+  // The source positions that contribute to component c
+  std::vector<int> positions;
+  switch (op_class) {
+  case CLASS_COMPONENTWISE:
+    positions.push_back(c);
+    break;
+  case CLASS_SCALAR:
+    positions.push_back(0);
+    break;
+  case CLASS_DOT3:
+    positions.push_back(0);
+    positions.push_back(1);
+    positions.push_back(2);
+    break;
+  case CLASS_DOT4:
+    positions.push_back(0);
+    positions.push_back(1);
+    positions.push_back(2);
+    positions.push_back(3);
+    break;
+  case CLASS_LIT:
+    // Every component of LIT is computed differently
+    key.push_back(c);
+    positions.push_back(0);
+    positions.push_back(1);
+    positions.push_back(3);
+    break;
+  }
+
+  std::vector<std::vector<int> > operands(num_sources);
+  for (int i = 0; i < num_sources; i++) {
+    for (size_t p = 0; p < positions.size(); p++) {
+      operands[i].push_back(source_value(vt, instr.src[i], positions[p]));
+    }
+  }
+  // Order the operands of commutative instructions so that a + b and b + a
+  // get the same value number
+  if (is_commutative(instr.op) && operands[1] < operands[0]) {
+    std::swap(operands[0], operands[1]);
+  }
+  for (int i = 0; i < num_sources; i++) {
+    key.insert(key.end(), operands[i].begin(), operands[i].end());
+  }
+  return lookup_value(vt, key);
+}
+
+// Checks that none of the components of reg in mask are written by the
+// instructions after index first up to and including index last
+static bool is_preserved(const std::vector<std::vector<int> > &writes,
+                         const ir_program &prog,
+                         int reg, unsigned char mask, int first, int last) {
+  const std::vector<int> &w = writes[reg];
+  std::vector<int>::const_iterator iter = std::upper_bound(w.begin(), w.end(), first);
+  for (; iter != w.end() && *iter <= last; iter++) {
+    if (prog.instructions[*iter].dst.mask & mask) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Finds a register other than exclude whose components hold all of the
+// values, and that keeps them until instruction last
+static bool find_available(value_table &vt,
+                           const std::vector<std::vector<int> > &writes,
+                           int exclude, unsigned char mask, const int value[4],
+                           int first, int last, rename_info &found) {
+  const ir_program &prog = *vt.prog;
+
+  int first_comp = 0;
+  while (!(mask & (1 << first_comp))) {
+    first_comp++;
+  }
+
+  std::set<location> &candidates = vt.locations[value[first_comp]];
+  std::set<location>::iterator iter;
+  for (iter = candidates.begin(); iter != candidates.end(); iter++) {
+    int reg = iter->first;
+    if (reg == exclude || prog.registers[reg].write_only) {
+      continue;
+    }
+
+    // Every component in mask must be held by some component of reg
+    bool all_found = true;
+    unsigned char used = 0;
+    for (int c = 0; c < 4 && all_found; c++) {
+      found.components[c] = iter->second;
+      if (!(mask & (1 << c))) {
+        continue;
+      }
+      all_found = false;
+      for (int k = 0; k < 4; k++) {
+        if (vt.current[reg * 4 + k] == value[c]) {
+          found.components[c] = k;
+          used |= 1 << k;
+          all_found = true;
+          break;
+        }
+      }
+    }
+
+    if (all_found && is_preserved(writes, prog, reg, used, first, last)) {
+      found.reg = reg;
+      return true;
+    }
+  }
+  return false;
+}
+
+int value_numbering(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+
+  // Find the instructions that write every register, the last instruction
+  // that reads every register and the components of it that are ever read
+  std::vector<std::vector<int> > writes(num_registers);
+  std::vector<int> last_use(num_registers, -1);
+  std::vector<unsigned char> read_mask(num_registers, 0);
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    writes[instr.dst.reg].push_back(i);
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      last_use[instr.src[j].reg] = i;
+      read_mask[instr.src[j].reg] |= ir_source_components(instr, j);
+    }
+  }
+
+  value_table vt;
+  vt.prog = &prog;
+  vt.num_values = 0;
+  vt.current.assign(num_registers * 4, -1);
+
+  // Temporaries whose uses are redirected to another register
+  std::map<int, rename_info> renamed;
+
+  ir_instruction_list kept;
+  int eliminated = 0;
+
+  for (int i = 0; i < num_instructions; i++) {
+    ir_instruction instr = prog.instructions[i];
+
+    // Redirect the sources that read an eliminated temporary
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      std::map<int, rename_info>::iterator iter = renamed.find(instr.src[j].reg);
+      if (iter != renamed.end()) {
+        instr.src[j].reg = iter->second.reg;
+        for (int p = 0; p < 4; p++) {
+          instr.src[j].swizzle[p] = iter->second.components[instr.src[j].swizzle[p]];
+        }
+      }
+    }
+
+    // A select between two equal values is a copy of them
+    if (instr.op == IR_CMP && selects_equal_values(vt, instr)) {
+      instr.op = IR_MOV;
+      instr.src[0] = instr.src[1];
+      instr.src[1] = instr.src[2] = ir_no_src();
+    }
+
+    int dst = instr.dst.reg;
+    int value[4] = { -1, -1, -1, -1 };
+    bool already_held = true;
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        value[c] = instruction_value(vt, instr, c);
+        if (vt.current[dst * 4 + c] != value[c]) {
+          already_held = false;
+        }
+      }
+    }
+
+    // The destination already holds the result
+    if (already_held) {
+      eliminated++;
+      continue;
+    }
+
+    // The result is available in another register. Components of the
+    // temporary that are read but never written can't be redirected
+    rename_info found;
+    if (prog.registers[dst].kind == REGISTER_TEMP && writes[dst].size() == 1 &&
+        !(read_mask[dst] & ~instr.dst.mask) &&
+        find_available(vt, writes, dst, instr.dst.mask, value, i, last_use[dst], found)) {
+      renamed[dst] = found;
+      eliminated++;
+      continue;
+    }
+
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        set_value(vt, dst, c, value[c]);
+      }
+    }
+    kept.push_back(instr);
+  }
+
+  prog.instructions.swap(kept);
+  return eliminated;
+}
+
+/****** MULTIPLY-ADD FUSION ******/
+/*
+ * A MUL into a temporary whose only use is an ADD or SUB is folded into
+ * that instruction as a MAD, using the negate modifier for subtraction:
+ *   MUL t, a, b; ADD d, t, c  ->  MAD d, a, b, c
+ *   MUL t, a, b; ADD d, c, t  ->  MAD d, a, b, c
+ *   MUL t, a, b; SUB d, t, c  ->  MAD d, a, b, -c
+ *   MUL t, a, b; SUB d, c, t  ->  MAD d, -a, b, c
+ * The swizzle and negation that the ADD or SUB reads the temporary with
+ * are moved onto a and b. The product is now computed where the ADD or SUB
+ * was, so neither a nor b may be written in between.
+ */
+
+int multiply_add_fusion(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+
+  // Count the writes and reads of every register, and find the last
+  // instruction that reads it
+  std::vector<int> num_writes(num_registers, 0);
+  std::vector<int> num_reads(num_registers, 0);
+  std::vector<int> last_use(num_registers, -1);
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    num_writes[instr.dst.reg]++;
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      num_reads[instr.src[j].reg]++;
+      last_use[instr.src[j].reg] = i;
+    }
+  }
+
+  std::vector<bool> fused(num_instructions, false);
+  int num_fused = 0;
+
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &mul = prog.instructions[i];
+    int temp = mul.dst.reg;
+    if (mul.op != IR_MUL || mul.saturate ||
+        prog.registers[temp].kind != REGISTER_TEMP ||
+        num_writes[temp] != 1 || num_reads[temp] != 1 || last_use[temp] <= i) {
+      continue;
+    }
+
+    ir_instruction &use = prog.instructions[last_use[temp]];
+    if (use.op != IR_ADD && use.op != IR_SUB) {
+      continue;
+    }
+    int k = use.src[0].reg == temp ? 0 : 1;
+    if (ir_source_components(use, k) & ~mul.dst.mask) {
+      continue;
+    }
+
+    bool overwritten = false;
+    for (int j = i + 1; j < last_use[temp]; j++) {
+      int reg = prog.instructions[j].dst.reg;
+      if (reg == mul.src[0].reg || reg == mul.src[1].reg) {
+        overwritten = true;
+      }
+    }
+    if (overwritten) {
+      continue;
+    }
+
+    const unsigned char *swizzle = use.src[k].swizzle;
+    ir_src a = ir_swizzle(mul.src[0], swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+    ir_src b = ir_swizzle(mul.src[1], swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+    ir_src c = use.src[1 - k];
+    if (use.src[k].negate) {
+      a = ir_negate(a);
+    }
+    if (use.op == IR_SUB) {
+      if (k == 0) {
+        c = ir_negate(c);
+      } else {
+        a = ir_negate(a);
+      }
+    }
+
+    use.op = IR_MAD;
+    use.src[0] = a;
+    use.src[1] = b;
+    use.src[2] = c;
+    fused[i] = true;
+    num_fused++;
+  }
+
+  ir_instruction_list kept;
+  for (int i = 0; i < num_instructions; i++) {
+    if (!fused[i]) {
+      kept.push_back(prog.instructions[i]);
+    }
+  }
+  prog.instructions.swap(kept);
+  return num_fused;
+}
+
+/****** DEAD CODE ELIMINATION ******/
+/*
+ * A temporary is dead once none of the components it holds are read before
+ * they are overwritten or the program ends, so an instruction that only
+ * writes dead components can be removed. Liveness is tracked per register
+ * component, backwards from the end of the program.
+ *
+ * Writes to variables are normally kept, even if the shader never reads
+ * the value again, so that the code of every statement stays in the
+ * output.
+ */
+
+int dead_code_elimination(ir_program &prog, bool keep_variables) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+
+  std::vector<unsigned char> live(num_registers, 0);
+  std::vector<bool> dead(num_instructions, false);
+  int eliminated = 0;
+  for (int i = num_instructions - 1; i >= 0; i--) {
+    const ir_instruction &instr = prog.instructions[i];
+    register_kind kind = prog.registers[instr.dst.reg].kind;
+    if ((kind == REGISTER_TEMP || (kind == REGISTER_VARIABLE && !keep_variables)) &&
+        !(live[instr.dst.reg] & instr.dst.mask)) {
+      dead[i] = true;
+      eliminated++;
+      continue;
+    }
+    live[instr.dst.reg] &= ~instr.dst.mask;
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      live[instr.src[j].reg] |= ir_source_components(instr, j);
+    }
+  }
+
+  ir_instruction_list kept;
+  for (int i = 0; i < num_instructions; i++) {
+    if (!dead[i]) {
+      kept.push_back(prog.instructions[i]);
+    }
+  }
+  prog.instructions.swap(kept);
+  return eliminated;
+}
+
+/****** SATURATION ******/
+/*
+ * Clamping to [0, 1] is written with if statements in miniGLSL, e.g.
+ *   if (d < 0.0) d = 0.0;
+ *   if (d > 1.0) d = 1.0;
+ * which become CMPs on the sign of d and of 1.0 - d. The clamp is folded
+ * into the _SAT suffix of the instruction that computes d in three steps:
+ *
+ *   1. A CMP whose selector is the difference of the two values it selects
+ *      between is a MIN or MAX of them: CMP d, a - b, a, b is MIN d, a, b.
+ *   2. The range of values of every register component is tracked forward.
+ *      MAX with 0 and MIN with 1 are dropped when the range shows that they
+ *      don't change anything, and become MOV_SAT when the range shows that
+ *      the other side of the clamp can't be reached. A _SAT whose result is
+ *      already in [0, 1] is dropped, so values aren't clamped twice.
+ *   3. A MOV_SAT of a value that was just computed is folded into the
+ *      instruction that computed it.
+ *
+ * Dead code elimination removes the differences that the CMPs selected on,
+ * and the steps are repeated until nothing changes.
+ */
+
+typedef struct {
+  float lo, hi;
+} value_range;
+
+// One component of a source, or the literal 0 if reg is -1
+typedef struct {
+  int reg;
+  int component;
+  bool negate;
+} component_ref;
+
+static const float INF = 1e30f;
+
+static component_ref source_component(const ir_src &src, int position) {
+  component_ref ref = { src.reg, src.swizzle[position], src.negate };
+  return ref;
+}
+
+static bool is_constant_component(const ir_program &prog, component_ref ref, float value) {
+  if (ref.reg < 0) {
+    return value == 0;
+  }
+  if (prog.registers[ref.reg].kind != REGISTER_CONSTANT) {
+    return false;
+  }
+  float constant = prog.registers[ref.reg].value[ref.component];
+  return (ref.negate ? -constant : constant) == value;
+}
+
+static bool is_same_component(const ir_program &prog, component_ref a, component_ref b) {
+  if (a.reg < 0) {
+    return is_constant_component(prog, b, 0);
+  }
+  if (b.reg < 0) {
+    return is_constant_component(prog, a, 0);
+  }
+  return a.reg == b.reg && a.component == b.component && a.negate == b.negate;
+}
+
+// Step 1: finds the a and b that the selector of a CMP is a - b of in
+// component c. Selectors are either a temporary computed by a SUB, or
+// the value itself when it is compared to 0
+static void find_difference(const ir_program &prog,
+                            const std::vector<std::vector<int> > &writes,
+                            int i, int c, component_ref &a, component_ref &b) {
+  const ir_instruction &cmp = prog.instructions[i];
+  component_ref selector = source_component(cmp.src[0], c);
+  const std::vector<int> &w = writes[selector.reg];
+
+  if (prog.registers[selector.reg].kind == REGISTER_TEMP && w.size() == 1 && w[0] < i) {
+    const ir_instruction &sub = prog.instructions[w[0]];
+    if (sub.op == IR_SUB && !sub.saturate && (sub.dst.mask & (1 << selector.component)) &&
+        is_preserved(writes, prog, sub.src[0].reg, MASK_XYZW, w[0], i - 1) &&
+        is_preserved(writes, prog, sub.src[1].reg, MASK_XYZW, w[0], i - 1)) {
+      a = source_component(sub.src[0], selector.component);
+      b = source_component(sub.src[1], selector.component);
+      if (selector.negate) {
+        std::swap(a, b);
+      }
+      return;
+    }
+  }
+
+  a = selector;
+  b.reg = -1;
+}
+
+static int selects_to_min_max(ir_program &prog) {
+  int num_registers = prog.registers.size();
+  std::vector<std::vector<int> > writes(num_registers);
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    writes[prog.instructions[i].dst.reg].push_back(i);
+  }
+
+  int changed = 0;
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    ir_instruction &instr = prog.instructions[i];
+    if (instr.op != IR_CMP) {
+      continue;
+    }
+    bool is_min = true;
+    bool is_max = true;
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        component_ref a, b;
+        find_difference(prog, writes, i, c, a, b);
+        component_ref x = source_component(instr.src[1], c);
+        component_ref y = source_component(instr.src[2], c);
+        // a - b < 0 selects x, so x = a and y = b is the smaller one
+        is_min = is_min && is_same_component(prog, a, x) && is_same_component(prog, b, y);
+        is_max = is_max && is_same_component(prog, a, y) && is_same_component(prog, b, x);
+      }
+    }
+    if (is_min || is_max) {
+      instr.op = is_min ? IR_MIN : IR_MAX;
+      instr.src[0] = instr.src[1];
+      instr.src[1] = instr.src[2];
+      instr.src[2] = ir_no_src();
+      changed++;
+    }
+  }
+  return changed;
+}
+
+// Step 2
+static value_range source_range(const std::vector<value_range> &ranges,
+                                const ir_src &src, int position) {
+  value_range range = ranges[src.reg * 4 + src.swizzle[position]];
+  if (src.negate) {
+    value_range negated = { -range.hi, -range.lo };
+    return negated;
+  }
+  return range;
+}
+
+static value_range make_range(float lo, float hi) {
+  value_range range = { lo < -INF ? -INF : lo, hi > INF ? INF : hi };
+  return range;
+}
+
+static value_range multiply_ranges(value_range a, value_range b) {
+  // Infinite bounds times 0 don't give a bound
+  if (a.lo <= -INF || a.hi >= INF || b.lo <= -INF || b.hi >= INF) {
+    bool non_negative = (a.lo >= 0 && b.lo >= 0) || (a.hi <= 0 && b.hi <= 0);
+    return make_range(non_negative ? 0 : -INF, INF);
+  }
+  float p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+  return make_range(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+}
+
+// The range of values that instr writes into component c, before _SAT
+static value_range instruction_range(const std::vector<value_range> &ranges,
+                                     const ir_instruction &instr, int c) {
+  value_range a = make_range(-INF, INF), b = a, third = a;
+  int position = ir_get_class(instr.op) == CLASS_COMPONENTWISE ? c : 0;
+  int num_sources = ir_num_sources(instr.op);
+  if (num_sources > 0) a = source_range(ranges, instr.src[0], position);
+  if (num_sources > 1) b = source_range(ranges, instr.src[1], position);
+  if (num_sources > 2) third = source_range(ranges, instr.src[2], position);
+
+  switch (instr.op) {
+  case IR_MOV:
+    return a;
+  case IR_ABS:
+    return make_range(a.lo > 0 ? a.lo : (a.hi < 0 ? -a.hi : 0), std::max(-a.lo, a.hi));
+  case IR_ADD:
+    return make_range(a.lo + b.lo, a.hi + b.hi);
+  case IR_SUB:
+    return make_range(a.lo - b.hi, a.hi - b.lo);
+  case IR_MUL:
+    return multiply_ranges(a, b);
+  case IR_MAD: {
+    value_range product = multiply_ranges(a, b);
+    return make_range(product.lo + third.lo, product.hi + third.hi);
+  }
+  case IR_MIN:
+    return make_range(std::min(a.lo, b.lo), std::min(a.hi, b.hi));
+  case IR_MAX:
+    return make_range(std::max(a.lo, b.lo), std::max(a.hi, b.hi));
+  case IR_CMP:
+    return make_range(std::min(b.lo, third.lo), std::max(b.hi, third.hi));
+  case IR_SLT: case IR_SGE:
+    return make_range(0, 1);
+  case IR_RSQ: case IR_POW: case IR_EX2:
+    return make_range(0, INF);
+  case IR_DP3: case IR_DP4:
+    // The squared length of a vector
+    if (instr.src[0].reg == instr.src[1].reg && instr.src[0].negate == instr.src[1].negate &&
+        memcmp(instr.src[0].swizzle, instr.src[1].swizzle, 4) == 0) {
+      return make_range(0, INF);
+    }
+    return make_range(-INF, INF);
+  case IR_LIT:
+    switch (c) {
+    case 0: case 3:
+      return make_range(1, 1);
+    case 1:
+      return make_range(std::max(a.lo, 0.0f), std::max(a.hi, 0.0f));
+    default:
+      return make_range(0, INF);
+    }
+  default:
+    return make_range(-INF, INF);
+  }
+}
+
+// Checks if every component of src that instr reads is in [lo, hi]
+static bool is_source_within(const std::vector<value_range> &ranges,
+                             const ir_instruction &instr, const ir_src &src,
+                             float lo, float hi) {
+  for (int c = 0; c < 4; c++) {
+    if (instr.dst.mask & (1 << c)) {
+      value_range range = source_range(ranges, src, c);
+      if (range.lo < lo || range.hi > hi) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Checks if every component of src that instr reads is the constant value
+static bool is_constant_source(const ir_program &prog, const ir_instruction &instr,
+                               const ir_src &src, float value) {
+  for (int c = 0; c < 4; c++) {
+    if ((instr.dst.mask & (1 << c)) &&
+        !is_constant_component(prog, source_component(src, c), value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool is_identity_source(const ir_instruction &instr, const ir_src &src) {
+  for (int c = 0; c < 4; c++) {
+    if ((instr.dst.mask & (1 << c)) && src.swizzle[c] != c) {
+      return false;
+    }
+  }
+  return !src.negate;
+}
+
+// Removes the moves of register components onto themselves
+static int remove_self_moves(ir_program &prog) {
+  ir_instruction_list kept;
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    if (!(instr.op == IR_MOV && !instr.saturate && instr.src[0].reg == instr.dst.reg &&
+          is_identity_source(instr, instr.src[0]))) {
+      kept.push_back(instr);
+    }
+  }
+  int removed = prog.instructions.size() - kept.size();
+  prog.instructions.swap(kept);
+  return removed;
+}
+
+static void make_move(ir_instruction &instr, const ir_src &src, bool saturate) {
+  instr.op = IR_MOV;
+  instr.saturate = saturate;
+  instr.src[0] = src;
+  instr.src[1] = instr.src[2] = ir_no_src();
+}
+
+static int simplify_clamps(ir_program &prog) {
+  int num_registers = prog.registers.size();
+  std::vector<value_range> ranges(num_registers * 4);
+  for (int reg = 0; reg < num_registers; reg++) {
+    for (int c = 0; c < 4; c++) {
+      const ir_register &r = prog.registers[reg];
+      ranges[reg * 4 + c] = r.kind == REGISTER_CONSTANT ? make_range(r.value[c], r.value[c])
+                                                        : make_range(-INF, INF);
+    }
+  }
+
+  int changed = 0;
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    ir_instruction &instr = prog.instructions[i];
+
+    // MAX with 0 and MIN with 1, with the constant on either side
+    if ((instr.op == IR_MAX || instr.op == IR_MIN) && !instr.saturate) {
+      float bound = instr.op == IR_MAX ? 0 : 1;
+      for (int k = 0; k < 2; k++) {
+        const ir_src &value = instr.src[1 - k];
+        if (!is_constant_source(prog, instr, instr.src[k], bound)) {
+          continue;
+        }
+        if (instr.op == IR_MAX ? is_source_within(ranges, instr, value, 0, INF)
+                               : is_source_within(ranges, instr, value, -INF, 1)) {
+          // The clamp doesn't change the value
+          make_move(instr, value, false);
+          changed++;
+        } else if (instr.op == IR_MAX ? is_source_within(ranges, instr, value, -INF, 1)
+                                      : is_source_within(ranges, instr, value, 0, INF)) {
+          // Clamping to the other bound wouldn't change the value either
+          make_move(instr, value, true);
+          changed++;
+        }
+        break;
+      }
+    }
+
+    // A clamped MAX with 0 or MIN with 1 is just the clamp
+    if ((instr.op == IR_MAX || instr.op == IR_MIN) && instr.saturate) {
+      float bound = instr.op == IR_MAX ? 0 : 1;
+      for (int k = 0; k < 2; k++) {
+        if (is_constant_source(prog, instr, instr.src[k], bound)) {
+          make_move(instr, instr.src[1 - k], true);
+          changed++;
+          break;
+        }
+      }
+    }
+
+    value_range result[4];
+    bool within = true;
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        result[c] = instruction_range(ranges, instr, c);
+        within = within && result[c].lo >= 0 && result[c].hi <= 1;
+      }
+    }
+    if (instr.saturate && within) {
+      instr.saturate = false;
+      changed++;
+    }
+
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        if (instr.saturate) {
+          result[c] = make_range(std::min(std::max(result[c].lo, 0.0f), 1.0f),
+                                 std::max(std::min(result[c].hi, 1.0f), 0.0f));
+        }
+        ranges[instr.dst.reg * 4 + c] = result[c];
+      }
+    }
+  }
+
+  // Clamps that turned out to do nothing leave moves of a register onto itself
+  return changed + remove_self_moves(prog);
+}
+
+// Step 3
+static int fold_saturates(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+  std::vector<std::vector<int> > writes(num_registers);
+  std::vector<std::vector<int> > reads(num_registers);
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    writes[instr.dst.reg].push_back(i);
+    for (int j = 0; j < ir_num_sources(instr.op); j++) {
+      if (reads[instr.src[j].reg].empty() || reads[instr.src[j].reg].back() != i) {
+        reads[instr.src[j].reg].push_back(i);
+      }
+    }
+  }
+
+  // Registers whose uses have changed since they were found
+  std::vector<bool> changed_registers(num_registers, false);
+  std::vector<bool> folded(num_instructions, false);
+  int num_folded = 0;
+
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &move = prog.instructions[i];
+    if (move.op != IR_MOV || !move.saturate || move.src[0].negate) {
+      continue;
+    }
+    int dst = move.dst.reg;
+    int src = move.src[0].reg;
+    if (changed_registers[dst] || changed_registers[src]) {
+      continue;
+    }
+
+    // The last instruction before the move that writes the source, which
+    // must not be read by anything but the move
+    const std::vector<int> &w = writes[src];
+    std::vector<int>::const_iterator def = std::lower_bound(w.begin(), w.end(), i);
+    if (def == w.begin()) {
+      continue;
+    }
+    int d = *--def;
+    ir_instruction &producer = prog.instructions[d];
+    const std::vector<int> &r = reads[src];
+    std::vector<int>::const_iterator use = std::upper_bound(r.begin(), r.end(), d);
+    if (use == r.end() || *use != i) {
+      continue;
+    }
+
+    if (src == dst) {
+      // Clamping in place: the producer must write exactly the clamped
+      // components
+      if (producer.dst.mask != move.dst.mask || !is_identity_source(move, move.src[0])) {
+        continue;
+      }
+    } else {
+      // The producer writes the destination of the move instead, so the
+      // source must be a temporary that is only used by the move
+      if (prog.registers[src].kind != REGISTER_TEMP || w.size() != 1 || r.size() != 1) {
+        continue;
+      }
+      // Every component of a scalar or dot product result is the same, so
+      // any swizzle can be read from it
+      bool any_component = ir_get_class(producer.op) != CLASS_COMPONENTWISE &&
+                           ir_get_class(producer.op) != CLASS_LIT;
+      if (any_component) {
+        if ((ir_source_components(move, 0) & producer.dst.mask) != ir_source_components(move, 0)) {
+          continue;
+        }
+      } else if (producer.dst.mask != move.dst.mask || !is_identity_source(move, move.src[0])) {
+        continue;
+      }
+      // The destination must not be accessed in between
+      const std::vector<int> &dw = writes[dst];
+      const std::vector<int> &dr = reads[dst];
+      std::vector<int>::const_iterator wi = std::upper_bound(dw.begin(), dw.end(), d);
+      std::vector<int>::const_iterator ri = std::upper_bound(dr.begin(), dr.end(), d);
+      if ((wi != dw.end() && *wi < i) || (ri != dr.end() && *ri < i)) {
+        continue;
+      }
+      producer.dst = move.dst;
+    }
+
+    producer.saturate = true;
+    folded[i] = true;
+    num_folded++;
+    changed_registers[dst] = true;
+    changed_registers[src] = true;
+  }
+
+  ir_instruction_list kept;
+  for (int i = 0; i < num_instructions; i++) {
+    if (!folded[i]) {
+      kept.push_back(prog.instructions[i]);
+    }
+  }
+  prog.instructions.swap(kept);
+  return num_folded;
+}
+
+int saturation(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int changed;
+  do {
+    changed = selects_to_min_max(prog);
+    changed += simplify_clamps(prog);
+    changed += fold_saturates(prog);
+    changed += dead_code_elimination(prog);
+  } while (changed > 0);
+  return num_instructions - prog.instructions.size();
+}
+
+/****** VECTORIZATION ******/
+/*
+ * Scalar code writes one component per instruction, e.g. a constructor
+ *   MOV n.x, fragment.texcoord.x;
+ *   MOV n.y, fragment.texcoord.y;
+ * or the arithmetic on scalar temporaries. Two componentwise instructions
+ * with the same opcode can be merged into one that writes the components
+ * of both if:
+ *   - they write the same register, or the second one writes a temporary
+ *     that can be moved into components of the first one's destination
+ *     that the program never uses
+ *   - each source reads the same register with the same negation in both
+ *     (any swizzle can be combined), or constants that can be combined
+ *     into a new PARAM
+ *   - the second instruction can be moved up to the first one: none of its
+ *     sources are written in between, including by the first instruction,
+ *     and the components it writes aren't accessed in between
+ *
+ * Only instructions within a window after the first one are considered,
+ * so that compile time stays linear in the size of the program.
+ */
+
+static const int VECTORIZE_WINDOW = 32;
+
+typedef struct {
+  std::vector<unsigned char> written, read;
+} component_usage;
+
+static int count_components(unsigned char mask) {
+  int count = 0;
+  for (int c = 0; c < 4; c++) {
+    count += (mask >> c) & 1;
+  }
+  return count;
+}
+
+// Fills the swizzle of the positions outside of mask so that the source
+// prints as simply as possible
+static void complete_swizzle(ir_src &src, unsigned char mask) {
+  bool identity = true;
+  bool replicate = true;
+  int last = -1;
+  for (int c = 0; c < 4; c++) {
+    if (mask & (1 << c)) {
+      identity = identity && src.swizzle[c] == c;
+      replicate = replicate && (last < 0 || src.swizzle[c] == last);
+      last = src.swizzle[c];
+    }
+  }
+  for (int c = 0; c < 4; c++) {
+    if (!(mask & (1 << c))) {
+      src.swizzle[c] = identity && !replicate ? c : last;
+    }
+  }
+}
+
+// Combines the sources a and b of two instructions that write the
+// components in mask_a and mask_b into one source. Returns false if they
+// read different registers
+static bool combine_sources(ir_program &prog, const ir_src &a, unsigned char mask_a,
+                            const ir_src &b, unsigned char mask_b, ir_src &combined) {
+  const ir_register &reg_a = prog.registers[a.reg];
+  const ir_register &reg_b = prog.registers[b.reg];
+
+  if (a.reg == b.reg && a.negate == b.negate) {
+    combined = a;
+    for (int c = 0; c < 4; c++) {
+      if (mask_b & (1 << c)) {
+        combined.swizzle[c] = b.swizzle[c];
+      }
+    }
+  } else if (reg_a.kind == REGISTER_CONSTANT && reg_b.kind == REGISTER_CONSTANT) {
+    float value[4];
+    bool uniform = true;
+    int first = -1;
+    for (int c = 0; c < 4; c++) {
+      if ((mask_a | mask_b) & (1 << c)) {
+        const ir_src &src = (mask_a & (1 << c)) ? a : b;
+        float v = prog.registers[src.reg].value[src.swizzle[c]];
+        value[c] = src.negate ? -v : v;
+        if (first < 0) {
+          first = c;
+        }
+        uniform = uniform && value[c] == value[first];
+      }
+    }
+    for (int c = 0; c < 4; c++) {
+      if (!((mask_a | mask_b) & (1 << c))) {
+        value[c] = value[first];
+      }
+    }
+    if (uniform) {
+      combined = ir_make_src(ir_constant(prog, value[first], value[first], value[first], value[first]));
+    } else {
+      combined = ir_make_src(ir_constant(prog, value[0], value[1], value[2], value[3]));
+    }
+    return true;
+  } else {
+    return false;
+  }
+  complete_swizzle(combined, mask_a | mask_b);
+  return true;
+}
+
+// Merges instruction j into instruction i, assuming that j writes the
+// components in mask of the destination of i
+static bool merge_instructions(ir_program &prog, ir_instruction &i_instr,
+                               const ir_instruction &j_instr, unsigned char mask) {
+  int num_sources = ir_num_sources(i_instr.op);
+  ir_src combined[3];
+  bool merged = true;
+  for (int k = 0; k < num_sources && merged; k++) {
+    merged = combine_sources(prog, i_instr.src[k], i_instr.dst.mask,
+                             j_instr.src[k], mask, combined[k]);
+  }
+  if (!merged && is_commutative(i_instr.op)) {
+    merged = combine_sources(prog, i_instr.src[0], i_instr.dst.mask,
+                             j_instr.src[1], mask, combined[0]) &&
+             combine_sources(prog, i_instr.src[1], i_instr.dst.mask,
+                             j_instr.src[0], mask, combined[1]);
+    for (int k = 2; k < num_sources && merged; k++) {
+      merged = combine_sources(prog, i_instr.src[k], i_instr.dst.mask,
+                               j_instr.src[k], mask, combined[k]);
+    }
+  }
+  if (!merged) {
+    return false;
+  }
+  for (int k = 0; k < num_sources; k++) {
+    i_instr.src[k] = combined[k];
+  }
+  i_instr.dst.mask |= mask;
+  return true;
+}
+
+// Moves the components of j_instr to the components in mask, reading its
+// sources with the matching swizzles
+static ir_instruction move_components(const ir_instruction &j_instr, const int map[4],
+                                      unsigned char mask) {
+  ir_instruction moved = j_instr;
+  moved.dst.mask = mask;
+  for (int k = 0; k < ir_num_sources(j_instr.op); k++) {
+    for (int c = 0; c < 4; c++) {
+      if (j_instr.dst.mask & (1 << c)) {
+        moved.src[k].swizzle[map[c]] = j_instr.src[k].swizzle[c];
+      }
+    }
+  }
+  return moved;
+}
+
+// Redirects the sources of instr that read moved temporaries. Registers
+// added after the tables were sized are constants, which never move
+static void rename_sources(ir_instruction &instr, const std::vector<int> &renamed_to,
+                           const std::vector<std::vector<int> > &rename_map) {
+  for (int k = 0; k < ir_num_sources(instr.op); k++) {
+    int temp = instr.src[k].reg;
+    if (temp < (int) renamed_to.size() && renamed_to[temp] >= 0) {
+      instr.src[k].reg = renamed_to[temp];
+      for (int c = 0; c < 4; c++) {
+        instr.src[k].swizzle[c] = rename_map[temp][instr.src[k].swizzle[c]];
+      }
+    }
+  }
+}
+
+int vectorization(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+
+  // The components of every register that the program accesses, and the
+  // number of instructions that write each register
+  component_usage usage;
+  usage.written.assign(num_registers, 0);
+  usage.read.assign(num_registers, 0);
+  std::vector<int> num_writes(num_registers, 0);
+  for (int i = 0; i < num_instructions; i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    usage.written[instr.dst.reg] |= instr.dst.mask;
+    num_writes[instr.dst.reg]++;
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      usage.read[instr.src[k].reg] |= ir_source_components(instr, k);
+    }
+  }
+
+  std::vector<bool> merged(num_instructions, false);
+  // Component renames of temporaries that were moved into other registers
+  std::vector<int> renamed_to(num_registers, -1);
+  std::vector<std::vector<int> > rename_map(num_registers, std::vector<int>(4, 0));
+  int num_merged = 0;
+
+  for (int i = 0; i < num_instructions; i++) {
+    if (merged[i] || ir_get_class(prog.instructions[i].op) != CLASS_COMPONENTWISE) {
+      continue;
+    }
+
+    rename_sources(prog.instructions[i], renamed_to, rename_map);
+
+    // The components that the instructions between i and j access
+    std::map<int, unsigned char> written, read;
+    written[prog.instructions[i].dst.reg] = prog.instructions[i].dst.mask;
+
+    for (int j = i + 1; j < num_instructions && j <= i + VECTORIZE_WINDOW; j++) {
+      if (merged[j]) {
+        continue;
+      }
+      rename_sources(prog.instructions[j], renamed_to, rename_map);
+
+      // Combining constants adds registers
+      if (prog.registers.size() > renamed_to.size()) {
+        num_registers = prog.registers.size();
+        usage.written.resize(num_registers, 0);
+        usage.read.resize(num_registers, 0);
+        num_writes.resize(num_registers, 0);
+        renamed_to.resize(num_registers, -1);
+        rename_map.resize(num_registers, std::vector<int>(4, 0));
+      }
+
+      ir_instruction &i_instr = prog.instructions[i];
+      const ir_instruction &j_instr = prog.instructions[j];
+      int dst = i_instr.dst.reg;
+
+      bool candidate = j_instr.op == i_instr.op && j_instr.saturate == i_instr.saturate;
+      for (int k = 0; k < ir_num_sources(j_instr.op) && candidate; k++) {
+        candidate = !(written[j_instr.src[k].reg] & ir_source_components(j_instr, k));
+      }
+
+      if (candidate && j_instr.dst.reg == dst) {
+        unsigned char mask = j_instr.dst.mask;
+        if (!(mask & written[dst]) && !(mask & read[dst]) &&
+            merge_instructions(prog, i_instr, j_instr, mask)) {
+          merged[j] = true;
+          num_merged++;
+          written[dst] |= mask;
+          continue;
+        }
+      } else if (candidate && prog.registers[dst].kind == REGISTER_TEMP &&
+                 prog.registers[j_instr.dst.reg].kind == REGISTER_TEMP &&
+                 num_writes[j_instr.dst.reg] == 1) {
+        // Move the temporary into components of dst that are never used
+        unsigned char unused = ~(usage.written[dst] | usage.read[dst]) & MASK_XYZW;
+        if (count_components(unused) >= count_components(j_instr.dst.mask)) {
+          int map[4] = { 0, 0, 0, 0 };
+          unsigned char mask = 0;
+          for (int c = 0, free_c = 0; c < 4; c++) {
+            if (j_instr.dst.mask & (1 << c)) {
+              while (!(unused & (1 << free_c))) {
+                free_c++;
+              }
+              map[c] = free_c++;
+              mask |= 1 << map[c];
+            }
+          }
+          ir_instruction moved = move_components(j_instr, map, mask);
+          if (merge_instructions(prog, i_instr, moved, mask)) {
+            int temp = j_instr.dst.reg;
+            merged[j] = true;
+            num_merged++;
+            renamed_to[temp] = dst;
+            for (int c = 0; c < 4; c++) {
+              rename_map[temp][c] = map[c];
+            }
+            usage.written[dst] |= mask;
+            usage.read[dst] |= mask;
+            written[dst] |= mask;
+            continue;
+          }
+        }
+      }
+
+      // j stays where it is, so later instructions can't move above it
+      written[j_instr.dst.reg] |= j_instr.dst.mask;
+      for (int k = 0; k < ir_num_sources(j_instr.op); k++) {
+        read[j_instr.src[k].reg] |= ir_source_components(j_instr, k);
+      }
+      if (count_components(prog.instructions[i].dst.mask) == 4) {
+        break;
+      }
+    }
+  }
+
+  ir_instruction_list kept;
+  for (int i = 0; i < num_instructions; i++) {
+    if (merged[i]) {
+      continue;
+    }
+    rename_sources(prog.instructions[i], renamed_to, rename_map);
+    kept.push_back(prog.instructions[i]);
+  }
+  prog.instructions.swap(kept);
+  return num_merged;
+}
+
+/****** REGISTER PACKING ******/
+/*
+ * Every variable and temporary is declared as its own TEMP even though
+ * scalars only use .x, and most values are only live for a short part of
+ * the program. Since the program is a single basic block, the live range
+ * of a register component is the interval from its first access to its
+ * last one. Reads of an instruction happen before its writes, so each
+ * instruction has two points: 2i for reads and 2i + 1 for writes.
+ *
+ * Registers are packed in the order of their first access into the lanes
+ * of the TEMPs declared so far, trying the same components first and any
+ * free lanes after that. A register that fits nowhere keeps its own TEMP,
+ * and other registers can be packed into it later. Moving a register to
+ * other lanes only changes the write masks and swizzles that access it,
+ * except for the destination of LIT, whose components have fixed meanings.
+ * A copy into a register that is packed into the same components as its
+ * source disappears.
+ */
+
+typedef struct {
+  int first, last;
+} live_interval;
+
+typedef struct {
+  int reg;
+  int lane[4];
+} packed_location;
+
+// The intervals during which each lane of a packed TEMP holds a value,
+// indexed by their first point
+typedef std::map<int, int> lane_intervals;
+
+static bool is_lane_free(const lane_intervals &lane, live_interval interval) {
+  lane_intervals::const_iterator iter = lane.upper_bound(interval.first);
+  if (iter != lane.end() && iter->first <= interval.last) {
+    return false;
+  }
+  if (iter != lane.begin() && (--iter)->second >= interval.first) {
+    return false;
+  }
+  return true;
+}
+
+// Finds lanes of a packed TEMP for the components in used
+static bool find_lanes(const std::vector<lane_intervals> &lanes, const live_interval intervals[4],
+                       unsigned char used, bool fixed, int lane[4]) {
+  bool same = true;
+  for (int c = 0; c < 4; c++) {
+    lane[c] = c;
+    if ((used & (1 << c)) && !is_lane_free(lanes[c], intervals[c])) {
+      same = false;
+    }
+  }
+  if (same || fixed) {
+    return same;
+  }
+
+  unsigned char taken = 0;
+  for (int c = 0; c < 4; c++) {
+    if (!(used & (1 << c))) {
+      continue;
+    }
+    int l = 0;
+    while (l < 4 && ((taken & (1 << l)) || !is_lane_free(lanes[l], intervals[c]))) {
+      l++;
+    }
+    if (l == 4) {
+      return false;
+    }
+    lane[c] = l;
+    taken |= 1 << l;
+  }
+  return true;
+}
+
+static unsigned char map_mask(const packed_location &location, unsigned char mask) {
+  unsigned char mapped = 0;
+  for (int c = 0; c < 4; c++) {
+    if (mask & (1 << c)) {
+      mapped |= 1 << location.lane[c];
+    }
+  }
+  return mapped;
+}
+
+int register_packing(ir_program &prog) {
+  int num_instructions = prog.instructions.size();
+  int num_registers = prog.registers.size();
+
+  std::vector<unsigned char> used(num_registers, 0);
+  std::vector<bool> fixed(num_registers, false);
+  std::vector<live_interval> intervals(num_registers * 4);
+  for (int i = num_instructions - 1; i >= 0; i--) {
+    const ir_instruction &instr = prog.instructions[i];
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      unsigned char components = ir_source_components(instr, k);
+      for (int c = 0; c < 4; c++) {
+        if (components & (1 << c)) {
+          live_interval &interval = intervals[instr.src[k].reg * 4 + c];
+          if (!(used[instr.src[k].reg] & (1 << c))) {
+            interval.last = 2 * i;
+          }
+          interval.first = 2 * i;
+        }
+      }
+      used[instr.src[k].reg] |= components;
+    }
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        live_interval &interval = intervals[instr.dst.reg * 4 + c];
+        if (!(used[instr.dst.reg] & (1 << c))) {
+          interval.last = 2 * i + 1;
+          interval.first = 2 * i + 1;
+        } else {
+          interval.first = std::min(interval.first, 2 * i + 1);
+        }
+      }
+    }
+    used[instr.dst.reg] |= instr.dst.mask;
+    fixed[instr.dst.reg] = fixed[instr.dst.reg] || instr.op == IR_LIT;
+  }
+
+  // The registers that can be packed, in the order of their first access
+  std::vector<std::pair<int, int> > order;
+  for (int reg = 0; reg < num_registers; reg++) {
+    register_kind kind = prog.registers[reg].kind;
+    if (used[reg] && (kind == REGISTER_TEMP || kind == REGISTER_VARIABLE)) {
+      int first = 2 * num_instructions;
+      for (int c = 0; c < 4; c++) {
+        if (used[reg] & (1 << c)) {
+          first = std::min(first, intervals[reg * 4 + c].first);
+        }
+      }
+      order.push_back(std::make_pair(first, reg));
+    }
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<packed_location> locations(num_registers);
+  std::vector<int> packed;
+  std::vector<std::vector<lane_intervals> > lanes;
+  for (int reg = 0; reg < num_registers; reg++) {
+    locations[reg].reg = reg;
+    for (int c = 0; c < 4; c++) {
+      locations[reg].lane[c] = c;
+    }
+  }
+
+  for (size_t n = 0; n < order.size(); n++) {
+    int reg = order[n].second;
+    const live_interval *reg_intervals = &intervals[reg * 4];
+
+    size_t p = 0;
+    int lane[4];
+    while (p < packed.size() &&
+           !find_lanes(lanes[p], reg_intervals, used[reg], fixed[reg], lane)) {
+      p++;
+    }
+    if (p == packed.size()) {
+      packed.push_back(reg);
+      lanes.push_back(std::vector<lane_intervals>(4));
+      for (int c = 0; c < 4; c++) {
+        lane[c] = c;
+      }
+    }
+
+    locations[reg].reg = packed[p];
+    for (int c = 0; c < 4; c++) {
+      locations[reg].lane[c] = lane[c];
+      if (used[reg] & (1 << c)) {
+        lanes[p][lane[c]][reg_intervals[c].first] = reg_intervals[c].last;
+      }
+    }
+  }
+
+  for (int i = 0; i < num_instructions; i++) {
+    ir_instruction &instr = prog.instructions[i];
+    const packed_location &dst = locations[instr.dst.reg];
+    bool componentwise = ir_get_class(instr.op) == CLASS_COMPONENTWISE;
+    unsigned char mask = map_mask(dst, instr.dst.mask);
+    unsigned char positions = componentwise ? mask : ir_source_positions(instr);
+
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      ir_src src = instr.src[k];
+      if (componentwise) {
+        // The components of the destination moved, so the positions that
+        // compute them did too
+        for (int c = 0; c < 4; c++) {
+          if (instr.dst.mask & (1 << c)) {
+            src.swizzle[dst.lane[c]] = instr.src[k].swizzle[c];
+          }
+        }
+      }
+      const packed_location &location = locations[src.reg];
+      src.reg = location.reg;
+      for (int c = 0; c < 4; c++) {
+        if (positions & (1 << c)) {
+          src.swizzle[c] = location.lane[src.swizzle[c]];
+        }
+      }
+      complete_swizzle(src, positions);
+      instr.src[k] = src;
+    }
+    instr.dst = ir_make_dst(dst.reg, mask);
+  }
+
+  // Copies between registers that were packed into the same components
+  // are no longer needed
+  remove_self_moves(prog);
+  return order.size() - packed.size();
+}
@@ -0,0 +1,35 @@
+#ifndef _OPTIMIZE_H
+#define _OPTIMIZE_H
+
+#include "ir.h"
+
+// Remove computations whose value is already available in a register.
+// Returns the number of instructions that were eliminated.
+int value_numbering(ir_program &prog);
+
+// Fold multiplies whose only use is an addition or subtraction into MADs.
+// Returns the number of MADs that were formed.
+int multiply_add_fusion(ir_program &prog);
+
+// Remove instructions that only write temporaries that are never read,
+// and variables too unless keep_variables is set. Returns the number of
+// instructions that were removed.
+int dead_code_elimination(ir_program &prog, bool keep_variables = true);
+
+// Fold clamps to [0, 1] into the _SAT suffix of the instructions that
+// compute the clamped values, using the ranges of values that registers
+// hold to avoid clamping twice. Returns the number of instructions that
+// were eliminated.
+int saturation(ir_program &prog);
+
+// Merge scalar instructions with the same opcode into one instruction that
+// writes several components. Returns the number of instructions that were
+// merged into others.
+int vectorization(ir_program &prog);
+
+// Pack the variables and temporaries into the components of as few TEMPs
+// as possible, reusing components whose values are no longer live.
+// Returns the number of TEMPs that were saved.
+int register_packing(ir_program &prog);
+
+#endif
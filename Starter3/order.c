@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <vector>
+
+#include "order.h"
+#include "simplify.h"
+#include "common.h"
+
+/****** EVALUATION ORDER ******/
+/*
+ * Every expression other than a literal or a variable computes its value
+ * into a temporary, which stays live until the expression that uses it is
+ * computed. Evaluating the operand that needs more temporaries first means
+ * that fewer results have to be held while it is computed (Sethi-Ullman).
+ *
+ * The number of temporaries that an expression needs is:
+ *   - 0 for literals, variables and the negation of one of those, since
+ *     they are read directly as sources
+ *   - for operands evaluated in order, the largest of the number that each
+ *     operand needs plus one for every operand evaluated before it that
+ *     holds a temporary, and at least 1 for the result
+ *
+ * Binary operators can evaluate their right operand first, which the AST
+ * visitor follows. Expressions have no side effects, so this never changes
+ * their values.
+ *
+ * Chains of + or * over operands of the same type are also reassociated
+ * into a left-deep chain with the operands that need the most temporaries
+ * first, so that only the partial result is held while each one is
+ * computed. This rounds differently, so it isn't done for floats under
+ * strict numerics.
+ */
+
+typedef struct {
+  int reordered;
+  int reassociated;
+  int peak_before;
+  int peak_after;
+} order_stats;
+
+// Literals, variables and their negations are read directly as sources;
+// every other expression computes its value into a temporary
+static int holds_temporary(node *n) {
+  while (n->kind == UNARY_EXPRESSION_NODE && n->expression.unary.op == OP_UMINUS) {
+    n = n->expression.unary.right;
+  }
+  switch (n->kind) {
+  case UNARY_EXPRESSION_NODE: case BINARY_EXPRESSION_NODE:
+  case FUNCTION_NODE: case CONSTRUCTOR_NODE:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int order_expression(node *n, order_stats *stats);
+
+// The number of temporaries that evaluating n needs, in the current order
+static int count_temporaries(node *n) {
+  return order_expression(n, NULL);
+}
+
+static bool is_reassociable(node *n) {
+  if (n->kind != BINARY_EXPRESSION_NODE) {
+    return false;
+  }
+  binary_op op = n->expression.binary.op;
+  if (op != OP_PLUS && op != OP_MUL) {
+    return false;
+  }
+  return !strictNumerics || (n->expression.expr_type & (TYPE_INT | TYPE_IVEC));
+}
+
+// Collects the operands of the chain of operators rooted at n, and the
+// operators themselves in postorder
+static void collect_chain(node *root, node *n, std::vector<node *> &operands,
+                          std::vector<node *> &operators) {
+  if (n->kind == BINARY_EXPRESSION_NODE &&
+      n->expression.binary.op == root->expression.binary.op &&
+      n->expression.expr_type == root->expression.expr_type) {
+    collect_chain(root, n->expression.binary.left, operands, operators);
+    collect_chain(root, n->expression.binary.right, operands, operators);
+    operators.push_back(n);
+  } else {
+    operands.push_back(n);
+  }
+}
+
+static bool needs_more(std::pair<int, node *> a, std::pair<int, node *> b) {
+  return a.first > b.first;
+}
+
+// Rebuilds the chain rooted at n as a left-deep chain, reusing its
+// operator nodes. The root is the last operator in postorder, so it stays
+// the root and the parent of the chain doesn't change. The chain is only
+// kept if it needs fewer temporaries, since reassociating also changes
+// which multiplies can be fused into additions. Returns true if the chain
+// was rebuilt
+static bool reassociate(node *n) {
+  std::vector<node *> operands, operators;
+  collect_chain(n, n, operands, operators);
+  if (operands.size() < 3) {
+    return false;
+  }
+  for (size_t i = 0; i < operands.size(); i++) {
+    if (operands[i]->expression.expr_type != n->expression.expr_type) {
+      return false;
+    }
+    // Regrouping x * y * x * y would lose the common x * y
+    for (size_t j = 0; j < i; j++) {
+      if (is_same_expression(operands[i], operands[j])) {
+        return false;
+      }
+    }
+  }
+
+  std::vector<std::pair<int, node *> > sorted;
+  for (size_t i = 0; i < operands.size(); i++) {
+    sorted.push_back(std::make_pair(count_temporaries(operands[i]), operands[i]));
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), needs_more);
+
+  int before = count_temporaries(n);
+  std::vector<node> saved;
+  for (size_t i = 0; i < operators.size(); i++) {
+    saved.push_back(*operators[i]);
+  }
+
+  node *left = sorted[0].second;
+  for (size_t i = 1; i < sorted.size(); i++) {
+    node *op = operators[i - 1];
+    op->expression.binary.left = left;
+    op->expression.binary.right = sorted[i].second;
+    op->expression.binary.right_first = false;
+    left->parent = op;
+    sorted[i].second->parent = op;
+    left = op;
+  }
+  if (count_temporaries(n) < before) {
+    return true;
+  }
+
+  for (size_t i = 0; i < operators.size(); i++) {
+    *operators[i] = saved[i];
+    operators[i]->expression.binary.left->parent = operators[i];
+    operators[i]->expression.binary.right->parent = operators[i];
+  }
+  return false;
+}
+
+// Chooses the evaluation order of n and everything below it, or with no
+// stats only counts, and returns the number of temporaries that n needs.
+// The counts are computed bottom-up in a single walk over n
+static int order_expression(node *n, order_stats *stats) {
+  if (n == NULL) {
+    return 0;
+  }
+  switch (n->kind) {
+  case UNARY_EXPRESSION_NODE: {
+    int operand = order_expression(n->expression.unary.right, stats);
+    return n->expression.unary.op == OP_UMINUS ? operand : std::max(operand, 1);
+  }
+  case BINARY_EXPRESSION_NODE: {
+    if (stats != NULL && is_reassociable(n) && reassociate(n)) {
+      stats->reassociated++;
+    }
+    node *first = n->expression.binary.left;
+    node *second = n->expression.binary.right;
+    int first_needed = order_expression(first, stats);
+    int second_needed = order_expression(second, stats);
+
+    if (stats != NULL) {
+      bool right_first = second_needed > first_needed;
+      if (right_first != n->expression.binary.right_first) {
+        n->expression.binary.right_first = right_first;
+        stats->reordered++;
+      }
+    }
+    if (n->expression.binary.right_first) {
+      std::swap(first, second);
+      std::swap(first_needed, second_needed);
+    }
+    return std::max(std::max(first_needed, holds_temporary(first) + second_needed), 1);
+  }
+  case FUNCTION_NODE: case CONSTRUCTOR_NODE: {
+    node *argument = n->kind == FUNCTION_NODE ? n->expression.function.arguments
+                                              : n->expression.constructor.arguments;
+    int held = 0;
+    int needed = 1;
+    for (; argument != NULL; argument = argument->argument.next_argument) {
+      needed = std::max(needed, held + order_expression(argument->argument.expression, stats));
+      held += holds_temporary(argument->argument.expression);
+    }
+    return needed;
+  }
+  default:
+    return 0;
+  }
+}
+
+static void order_root(node *n, order_stats &stats) {
+  if (n == NULL) {
+    return;
+  }
+  stats.peak_before = std::max(stats.peak_before, count_temporaries(n));
+  stats.peak_after = std::max(stats.peak_after, order_expression(n, &stats));
+}
+
+static void order_preorder(node *n, void *data) {
+  order_stats &stats = *(order_stats *) data;
+  switch (n->kind) {
+  case DECLARATION_NODE:
+    order_root(n->declaration.assignment_expr, stats);
+    break;
+  case ASSIGNMENT_NODE:
+    order_root(n->statement.assignment.expression, stats);
+    break;
+  case IF_STATEMENT_NODE:
+    order_root(n->statement.if_else_statement.condition, stats);
+    break;
+  default:
+    break;
+  }
+}
+
+int order_expressions(node *ast) {
+  order_stats stats = { 0, 0, 0, 0 };
+  ast_visit(ast, order_preorder, NULL, &stats);
+
+  if (dumpStats) {
+    fprintf(dumpFile, "evaluation order: %d reordered, %d chains reassociated\n",
+            stats.reordered, stats.reassociated);
+    fprintf(dumpFile, "  peak temporaries per expression: %d before, %d after\n",
+            stats.peak_before, stats.peak_after);
+  }
+  return stats.reordered + stats.reassociated;
+}
@@ -0,0 +1,12 @@
+#ifndef _ORDER_H
+#define _ORDER_H
+
+#include "ast.h"
+
+// Choose the order in which the operands of every expression are evaluated
+// so that as few temporaries as possible are live at once, reassociating
+// chains of + and * unless numerics are strict. Returns the number of
+// expressions whose evaluation order was changed.
+int order_expressions(node *ast);
+
+#endif
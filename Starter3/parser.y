@@ -24,9 +24,11 @@
 #include "ast.h"
 #include "symbol.h"
 #include "semantic.h"
+#include "timing.h"
+#include "trace.h"
 
 #define YYERROR_VERBOSE
-#define yTRACE(x)    { if (traceParser) fprintf(traceFile, "%s\n", x); }
+#define yTRACE(x)    TRACE_RULE_EVENT(x)
 
 void yyerror(const char* s);    /* what to do in case of error            */
 int yylex();                    /* procedure for calling lexical analyzer */
@@ -137,7 +139,8 @@ program
 scope
   : {
       // Create a symbol table for this scope
-      symbol_tables.push_back(std::map<std::string, symbol_info>());
+      symbol_tables.push_back(symbol_map());
+      counters.scopes++;
 
       // Initialize new symbol table
       init_symbol_table(symbol_tables.back());
@@ -350,6 +353,7 @@ identifier
  * functions as necessary in subsequent phases.
  ***********************************************************************/
 void yyerror(const char* s) {
+  trace_flush();
   if(errorOccurred) {
     return;    /* Error has already been reported by scanner */
   } else {
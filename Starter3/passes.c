@@ -0,0 +1,186 @@
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#include "passes.h"
+#include "common.h"
+#include "cost.h"
+#include "optimize.h"
+#include "order.h"
+#include "simplify.h"
+#include "target.h"
+
+/****** PASS MANAGER ******/
+/*
+ * The passes run in the order of the table below. The optimization level
+ * chooses which of them run:
+ *   -O0  none, the program is printed as it was generated
+ *   -O1  the cheap passes, which simplify, reorder and remove work
+ *   -O2  every pass that makes the program faster (the default)
+ *   -Os  -O2, then constants are packed into as few PARAMs as possible
+ * and -P enables or disables single passes on top of that, which is
+ * useful to find the pass responsible for a miscompile.
+ *
+ * With -Dp every pass reports how long it took and, for the passes over
+ * the generated program, how the number of instructions and TEMPs
+ * changed. The AST passes run before there are any instructions.
+ */
+
+static const unsigned BASIC = 1 << OPTIMIZE_BASIC;
+static const unsigned FULL = 1 << OPTIMIZE_FULL;
+static const unsigned SIZE = 1 << OPTIMIZE_SIZE;
+
+static int eliminate_dead_code(ir_program &prog) {
+  return dead_code_elimination(prog);
+}
+
+typedef struct {
+  const char *name;
+  int (*run_ast)(node *ast);
+  int (*run_ir)(ir_program &prog);
+  // The -Do line of the pass, AST passes print their own
+  const char *stats;
+  // The optimization levels that run the pass
+  unsigned levels;
+} pass_info;
+
+static const pass_info passes[] = {
+  { "simplify",            simplify_ast,        NULL, NULL,
+    BASIC | FULL | SIZE },
+  { "evaluation-order",    order_expressions,   NULL, NULL,
+    BASIC | FULL | SIZE },
+  { "value-numbering",     NULL, value_numbering,
+    "value numbering: %d instructions eliminated",
+    BASIC | FULL | SIZE },
+  { "multiply-add-fusion", NULL, multiply_add_fusion,
+    "multiply-add fusion: %d MADs formed",
+    FULL | SIZE },
+  { "dead-code",           NULL, eliminate_dead_code,
+    "dead code elimination: %d instructions eliminated",
+    BASIC | FULL | SIZE },
+  { "saturation",          NULL, saturation,
+    "saturation: %d instructions eliminated",
+    FULL | SIZE },
+  { "vectorization",       NULL, vectorization,
+    "vectorization: %d instructions merged",
+    FULL | SIZE },
+  { "register-packing",    NULL, register_packing,
+    "register packing: %d TEMPs saved",
+    BASIC | FULL | SIZE },
+  // Packing registers leaves lanes free to merge into
+  { "vectorization",       NULL, vectorization,
+    "vectorization: %d instructions merged",
+    FULL | SIZE },
+  { "constant-packing",    NULL, repack_constants,
+    "constant packing: %d PARAMs saved",
+    SIZE },
+};
+
+static const int NUM_PASSES = sizeof(passes) / sizeof(passes[0]);
+
+static bool enabled[NUM_PASSES];
+
+void configure_passes(int level, const char *list) {
+  for (int p = 0; p < NUM_PASSES; p++) {
+    enabled[p] = (passes[p].levels >> level) & 1;
+  }
+  if (list == NULL) {
+    return;
+  }
+
+  std::string items(list);
+  size_t start = 0;
+  while (start <= items.size()) {
+    size_t end = items.find(',', start);
+    if (end == std::string::npos) {
+      end = items.size();
+    }
+    std::string name = items.substr(start, end - start);
+    start = end + 1;
+
+    bool enable = name.compare(0, 3, "no-") != 0;
+    if (!enable) {
+      name = name.substr(3);
+    }
+    bool found = false;
+    for (int p = 0; p < NUM_PASSES; p++) {
+      if (name == passes[p].name) {
+        enabled[p] = enable;
+        found = true;
+      }
+    }
+    if (!found) {
+      fprintf(errorFile, "Unknown pass %s ignored\n", name.c_str());
+    }
+  }
+}
+
+bool is_pass_enabled(const char *name) {
+  for (int p = 0; p < NUM_PASSES; p++) {
+    if (strcmp(name, passes[p].name) == 0) {
+      return enabled[p];
+    }
+  }
+  return false;
+}
+
+// Milliseconds since an arbitrary point
+static double now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+void run_ast_passes(node *ast) {
+  for (int p = 0; p < NUM_PASSES; p++) {
+    if (passes[p].run_ast == NULL) {
+      continue;
+    }
+    if (!enabled[p]) {
+      if (dumpPasses) {
+        fprintf(dumpFile, "%s: disabled\n", passes[p].name);
+      }
+      continue;
+    }
+
+    double start = now();
+    passes[p].run_ast(ast);
+    if (dumpPasses) {
+      fprintf(dumpFile, "%s: %.3f ms\n", passes[p].name, now() - start);
+    }
+  }
+}
+
+void run_ir_passes(ir_program &prog, ir_program *unpacked) {
+  for (int p = 0; p < NUM_PASSES; p++) {
+    if (passes[p].run_ir == NULL) {
+      continue;
+    }
+    if (unpacked != NULL && passes[p].run_ir == register_packing) {
+      *unpacked = prog;
+    }
+    if (!enabled[p]) {
+      if (dumpPasses) {
+        fprintf(dumpFile, "%s: disabled\n", passes[p].name);
+      }
+      continue;
+    }
+
+    program_cost before = ir_cost(prog);
+    double start = now();
+    int count = passes[p].run_ir(prog);
+    double time = now() - start;
+    program_cost after = ir_cost(prog);
+
+    if (dumpStats) {
+      fprintf(dumpFile, passes[p].stats, count);
+      fprintf(dumpFile, "\n");
+    }
+    if (dumpPasses) {
+      fprintf(dumpFile, "%s: %.3f ms, %d -> %d instructions (%+d), %d -> %d TEMPs (%+d)\n",
+              passes[p].name, time,
+              before.instructions, after.instructions, after.instructions - before.instructions,
+              before.temps, after.temps, after.temps - before.temps);
+    }
+  }
+}
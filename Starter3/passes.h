@@ -0,0 +1,22 @@
+#ifndef _PASSES_H
+#define _PASSES_H
+
+#include "ast.h"
+#include "ir.h"
+
+// Choose the passes that run from the optimization level, then apply the
+// comma separated list of pass names, where a name enables the pass and a
+// name prefixed by "no-" disables it
+void configure_passes(int level, const char *list);
+
+// Checks if the pass with the given name runs
+bool is_pass_enabled(const char *name);
+
+// Run the enabled passes over the type checked AST
+void run_ast_passes(node *ast);
+
+// Run the enabled passes over the generated program. If unpacked isn't
+// NULL, it receives the program just before register packing
+void run_ir_passes(ir_program &prog, ir_program *unpacked = NULL);
+
+#endif
@@ -0,0 +1,13 @@
+#include "probes.h"
+
+/****** PROBE SEMAPHORES ******/
+/*
+ * Tools that attach to a probe increment its semaphore, which has to be
+ * defined in the .probes section for them to find it.
+ */
+
+#ifdef HAVE_PROBES
+#define PROBE_SEMAPHORE(name) \
+  unsigned short compiler467_##name##_semaphore __attribute__((section(".probes")));
+PROBE_LIST(PROBE_SEMAPHORE)
+#endif
@@ -0,0 +1,66 @@
+#ifndef _PROBES_H
+#define _PROBES_H
+
+// USDT probes of the compiler467 provider, which tools like bpftrace and
+// perf can attach to without rebuilding the compiler:
+//
+//   phase__begin(int phase, char *name)
+//   phase__end(int phase, char *name, long ns)  ns is 0 if the probe was
+//                                                attached during the phase
+//   parse__start()
+//   parse__done(int failed, int tokens, int nodes, int scopes)
+//   semantic__start(int nodes)
+//   semantic__done(int failed, int symbol_lookups)
+//   codegen__start(int nodes)
+//   codegen__done(int failed, int emitted, int instructions, int temps)
+//   ast__alloc(int nodes, long bytes)  fired for every AST_PROBE_BATCH nodes
+//   symbol__hit(char *name, int depth) depth 0 is the innermost scope
+//   symbol__miss(char *name, int scopes)
+//
+// They compile to nothing without sys/sdt.h, or with NO_PROBES defined
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_PROBES 1
+#endif
+#endif
+
+#define PROBE_LIST(X) \
+  X(phase__begin) X(phase__end) \
+  X(parse__start) X(parse__done) \
+  X(semantic__start) X(semantic__done) \
+  X(codegen__start) X(codegen__done) \
+  X(ast__alloc) X(symbol__hit) X(symbol__miss)
+
+#ifdef HAVE_PROBES
+
+// Every probe has a semaphore that counts the tools attached to it, so
+// that arguments which cost something are only computed when needed
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_SEMAPHORE(name) extern unsigned short compiler467_##name##_semaphore;
+PROBE_LIST(PROBE_SEMAPHORE)
+#undef PROBE_SEMAPHORE
+
+#define PROBE_ENABLED(name) __builtin_expect(compiler467_##name##_semaphore != 0, 0)
+#define PROBE0(name) DTRACE_PROBE(compiler467, name)
+#define PROBE1(name, a) DTRACE_PROBE1(compiler467, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(compiler467, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(compiler467, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(compiler467, name, a, b, c, d)
+
+#else
+
+#define PROBE_ENABLED(name) false
+#define PROBE0(name)
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#define PROBE4(name, a, b, c, d)
+
+#endif
+
+// The number of AST nodes between ast__alloc probes
+#define AST_PROBE_BATCH 256
+
+#endif
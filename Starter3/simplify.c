@@ -0,0 +1,405 @@
+#include <string.h>
+
+#include "simplify.h"
+#include "common.h"
+
+/****** ALGEBRAIC SIMPLIFICATION ******/
+/*
+ * Expressions are rewritten bottom up. Once the operands of an expression
+ * have been simplified, the rules below are applied to it until none of
+ * them matches. A rule only replaces an expression by one of its operands,
+ * by a literal or by a negation or operator over operands that are already
+ * simplified, so afterwards no rule matches anywhere in the tree. Unary
+ * minus is free since it becomes a negate modifier on the source that
+ * reads it, and the rules that introduce ! remove at least one other !.
+ *
+ * Literals are put on the right of commutative operators first, so only
+ * x * 1 has to be matched and not 1 * x as well.
+ *
+ * x * 0 and x - x aren't 0 when x is infinite or NaN, and !(a < b) isn't
+ * a >= b when either is NaN, so these rules are skipped under strict
+ * numerics.
+ */
+
+typedef enum {
+  RULE_FOLD_CONSTANT,     // 2.0 * 3.0 = 6.0, -(2.0) = -2.0, !true = false
+  RULE_CANONICAL_ORDER,   // 1.0 * x = x * 1.0
+  RULE_MUL_ONE,           // x * 1 = x, x * -1 = -x, x / 1 = x, x / -1 = -x
+  RULE_MUL_ZERO,          // x * 0 = 0
+  RULE_ADD_ZERO,          // x + 0 = x, x - 0 = x, 0 - x = -x
+  RULE_SUB_SELF,          // x - x = 0
+  RULE_DOUBLE_NEGATION,   // - -x = x
+  RULE_DOUBLE_NOT,        // !!b = b
+  RULE_BOOLEAN_IDENTITY,  // b && true = b, b && false = false, b || false = b, b || true = true
+  RULE_INVERT_COMPARISON, // !(a < b) = a >= b
+  RULE_DE_MORGAN,         // !a && !b = !(a || b), !a || !b = !(a && b)
+  NUM_RULES
+} simplify_rule;
+
+static const char *rule_names[NUM_RULES] = {
+  "fold constant",
+  "canonical order",
+  "multiply by one",
+  "multiply by zero",
+  "add zero",
+  "subtract self",
+  "double negation",
+  "double not",
+  "boolean identity",
+  "invert comparison",
+  "de morgan",
+};
+
+static int rule_hits[NUM_RULES];
+
+static bool is_literal(node *n) {
+  return n->kind == INT_NODE || n->kind == FLOAT_NODE || n->kind == BOOL_NODE;
+}
+
+static float literal_value(node *n) {
+  switch (n->kind) {
+  case INT_NODE:
+    return n->expression.int_expr.val;
+  case FLOAT_NODE:
+    return n->expression.float_expr.val;
+  default:
+    return n->expression.bool_expr.val ? 1 : 0;
+  }
+}
+
+static bool is_scalar(node *n) {
+  return !(n->expression.expr_type & TYPE_ANY_VEC);
+}
+
+// Makes a literal of the type of n at its position in the source
+static node *make_literal(node *n, float value) {
+  node *literal;
+  switch (n->expression.expr_type) {
+  case TYPE_BOOL:
+    literal = ast_allocate(BOOL_NODE, value != 0);
+    break;
+  case TYPE_INT:
+    literal = ast_allocate(INT_NODE, (int) value);
+    break;
+  default:
+    literal = ast_allocate(FLOAT_NODE, (double) value);
+    break;
+  }
+  literal->line = n->line;
+  literal->column = n->column;
+  return literal;
+}
+
+static node *make_unary(node *n, unary_op op, node *operand) {
+  node *unary = ast_allocate(UNARY_EXPRESSION_NODE, op, operand);
+  unary->line = n->line;
+  unary->column = n->column;
+  return unary;
+}
+
+// Detaches an operand from its expression so that it isn't freed with it
+static node *detach(node *operand) {
+  node *parent = operand->parent;
+  if (parent->kind == UNARY_EXPRESSION_NODE) {
+    parent->expression.unary.right = NULL;
+  } else if (parent->expression.binary.left == operand) {
+    parent->expression.binary.left = NULL;
+  } else {
+    parent->expression.binary.right = NULL;
+  }
+  return operand;
+}
+
+// Replaces expression by replacement, which must not be part of it anymore
+static node *replace(node *expression, node *replacement, simplify_rule rule) {
+  replacement->parent = expression->parent;
+  ast_free(expression);
+  rule_hits[rule]++;
+  return replacement;
+}
+
+// Within one expression, the same name always refers to the same variable
+bool is_same_expression(node *a, node *b) {
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+  if (a->kind != b->kind) {
+    return false;
+  }
+  switch (a->kind) {
+  case INT_NODE: case FLOAT_NODE: case BOOL_NODE:
+    return literal_value(a) == literal_value(b);
+  case IDENT_NODE:
+    return strcmp(a->expression.ident.val, b->expression.ident.val) == 0;
+  case VAR_NODE:
+    return is_same_expression(a->expression.variable.identifier, b->expression.variable.identifier) &&
+           is_same_expression(a->expression.variable.index, b->expression.variable.index);
+  case UNARY_EXPRESSION_NODE:
+    return a->expression.unary.op == b->expression.unary.op &&
+           is_same_expression(a->expression.unary.right, b->expression.unary.right);
+  case BINARY_EXPRESSION_NODE:
+    return a->expression.binary.op == b->expression.binary.op &&
+           is_same_expression(a->expression.binary.left, b->expression.binary.left) &&
+           is_same_expression(a->expression.binary.right, b->expression.binary.right);
+  case FUNCTION_NODE:
+    return a->expression.function.func_id == b->expression.function.func_id &&
+           is_same_expression(a->expression.function.arguments, b->expression.function.arguments);
+  case CONSTRUCTOR_NODE:
+    return a->expression.expr_type == b->expression.expr_type &&
+           is_same_expression(a->expression.constructor.arguments, b->expression.constructor.arguments);
+  case ARGUMENT_NODE:
+    return is_same_expression(a->argument.expression, b->argument.expression) &&
+           is_same_expression(a->argument.next_argument, b->argument.next_argument);
+  default:
+    return false;
+  }
+}
+
+// Computes the value of an operator whose operands are all scalar literals
+static bool fold_constant(node *n, float *value) {
+  if (n->kind == UNARY_EXPRESSION_NODE) {
+    node *right = n->expression.unary.right;
+    if (!is_literal(right)) {
+      return false;
+    }
+    float r = literal_value(right);
+    *value = n->expression.unary.op == OP_NOT ? !r : -r;
+    return true;
+  }
+
+  if (n->kind != BINARY_EXPRESSION_NODE) {
+    return false;
+  }
+  node *left = n->expression.binary.left;
+  node *right = n->expression.binary.right;
+  if (!is_literal(left) || !is_literal(right)) {
+    return false;
+  }
+  float l = literal_value(left);
+  float r = literal_value(right);
+  switch (n->expression.binary.op) {
+  case OP_AND:   *value = l < r ? l : r; return true;
+  case OP_OR:    *value = l > r ? l : r; return true;
+  case OP_EQ:    *value = l == r; return true;
+  case OP_NEQ:   *value = l != r; return true;
+  case OP_LT:    *value = l < r; return true;
+  case OP_LEQ:   *value = l <= r; return true;
+  case OP_GT:    *value = l > r; return true;
+  case OP_GEQ:   *value = l >= r; return true;
+  case OP_PLUS:  *value = l + r; return true;
+  case OP_MINUS: *value = l - r; return true;
+  case OP_MUL:   *value = l * r; return true;
+  case OP_DIV:
+    // Integer division isn't folded since it is computed with floats
+    if (left->kind == FLOAT_NODE && r != 0) {
+      *value = l / r;
+      return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+static bool is_commutative(binary_op op) {
+  return op == OP_AND || op == OP_OR || op == OP_EQ || op == OP_NEQ ||
+         op == OP_PLUS || op == OP_MUL;
+}
+
+static binary_op invert_comparison(binary_op op) {
+  switch (op) {
+  case OP_LT:  return OP_GEQ;
+  case OP_LEQ: return OP_GT;
+  case OP_GT:  return OP_LEQ;
+  case OP_GEQ: return OP_LT;
+  case OP_EQ:  return OP_NEQ;
+  default:     return OP_EQ;
+  }
+}
+
+static bool is_not(node *n) {
+  return n->kind == UNARY_EXPRESSION_NODE && n->expression.unary.op == OP_NOT;
+}
+
+// Replaces the ! operand of n by the operand of the !
+static void remove_not(node *n, node *not_operand) {
+  node *operand = detach(not_operand->expression.unary.right);
+  operand->parent = n;
+  if (n->expression.binary.left == not_operand) {
+    n->expression.binary.left = operand;
+  } else {
+    n->expression.binary.right = operand;
+  }
+  ast_free(not_operand);
+}
+
+static bool is_comparison(node *n) {
+  if (n->kind != BINARY_EXPRESSION_NODE) {
+    return false;
+  }
+  binary_op op = n->expression.binary.op;
+  return op == OP_LT || op == OP_LEQ || op == OP_GT || op == OP_GEQ ||
+         op == OP_EQ || op == OP_NEQ;
+}
+
+// Applies the first rule that matches n. Returns what n is replaced by, or
+// NULL if no rule matches
+static node *apply_rule(node *n) {
+  float value;
+  if (fold_constant(n, &value)) {
+    return replace(n, make_literal(n, value), RULE_FOLD_CONSTANT);
+  }
+
+  if (n->kind == UNARY_EXPRESSION_NODE) {
+    node *right = n->expression.unary.right;
+    if (right->kind != UNARY_EXPRESSION_NODE) {
+      if (n->expression.unary.op == OP_NOT && is_comparison(right) && !strictNumerics) {
+        right->expression.binary.op = invert_comparison(right->expression.binary.op);
+        return replace(n, detach(right), RULE_INVERT_COMPARISON);
+      }
+      return NULL;
+    }
+    if (right->expression.unary.op == n->expression.unary.op) {
+      return replace(n, detach(right->expression.unary.right),
+                     n->expression.unary.op == OP_NOT ? RULE_DOUBLE_NOT : RULE_DOUBLE_NEGATION);
+    }
+    return NULL;
+  }
+
+  if (n->kind != BINARY_EXPRESSION_NODE) {
+    return NULL;
+  }
+
+  binary_op op = n->expression.binary.op;
+  node *left = n->expression.binary.left;
+  node *right = n->expression.binary.right;
+
+  if (is_commutative(op) && is_literal(left) && !is_literal(right)) {
+    n->expression.binary.left = right;
+    n->expression.binary.right = left;
+    rule_hits[RULE_CANONICAL_ORDER]++;
+    return n;
+  }
+
+  if (is_literal(right)) {
+    value = literal_value(right);
+    switch (op) {
+    case OP_MUL:
+      if (value == 1) {
+        return replace(n, detach(left), RULE_MUL_ONE);
+      }
+      if (value == -1) {
+        return replace(n, make_unary(n, OP_UMINUS, detach(left)), RULE_MUL_ONE);
+      }
+      // There is no vector literal that could replace a vector product
+      if (value == 0 && is_scalar(n) && !strictNumerics) {
+        return replace(n, make_literal(n, 0), RULE_MUL_ZERO);
+      }
+      break;
+    case OP_DIV:
+      if (value == 1) {
+        return replace(n, detach(left), RULE_MUL_ONE);
+      }
+      if (value == -1) {
+        return replace(n, make_unary(n, OP_UMINUS, detach(left)), RULE_MUL_ONE);
+      }
+      break;
+    case OP_PLUS: case OP_MINUS:
+      if (value == 0) {
+        return replace(n, detach(left), RULE_ADD_ZERO);
+      }
+      break;
+    case OP_AND:
+      return value ? replace(n, detach(left), RULE_BOOLEAN_IDENTITY)
+                   : replace(n, make_literal(n, 0), RULE_BOOLEAN_IDENTITY);
+    case OP_OR:
+      return value ? replace(n, make_literal(n, 1), RULE_BOOLEAN_IDENTITY)
+                   : replace(n, detach(left), RULE_BOOLEAN_IDENTITY);
+    default:
+      break;
+    }
+  }
+
+  if (op == OP_MINUS && is_literal(left) && literal_value(left) == 0) {
+    return replace(n, make_unary(n, OP_UMINUS, detach(right)), RULE_ADD_ZERO);
+  }
+  if (op == OP_MINUS && is_scalar(n) && !strictNumerics && is_same_expression(left, right)) {
+    return replace(n, make_literal(n, 0), RULE_SUB_SELF);
+  }
+
+  if ((op == OP_AND || op == OP_OR) && is_not(left) && is_not(right)) {
+    remove_not(n, left);
+    remove_not(n, right);
+    n->expression.binary.op = op == OP_AND ? OP_OR : OP_AND;
+    node *parent = n->parent;
+    node *negation = make_unary(n, OP_NOT, n);
+    negation->parent = parent;
+    rule_hits[RULE_DE_MORGAN]++;
+    return negation;
+  }
+  return NULL;
+}
+
+static node *simplify_expression(node *n) {
+  switch (n->kind) {
+  case UNARY_EXPRESSION_NODE:
+    n->expression.unary.right = simplify_expression(n->expression.unary.right);
+    break;
+  case BINARY_EXPRESSION_NODE:
+    n->expression.binary.left = simplify_expression(n->expression.binary.left);
+    n->expression.binary.right = simplify_expression(n->expression.binary.right);
+    break;
+  case FUNCTION_NODE: case CONSTRUCTOR_NODE: {
+    node *argument = n->kind == FUNCTION_NODE ? n->expression.function.arguments
+                                              : n->expression.constructor.arguments;
+    for (; argument != NULL; argument = argument->argument.next_argument) {
+      argument->argument.expression = simplify_expression(argument->argument.expression);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  node *simplified;
+  while ((simplified = apply_rule(n)) != NULL) {
+    n = simplified;
+  }
+  return n;
+}
+
+static void simplify_preorder(node *n, void *data) {
+  switch (n->kind) {
+  case DECLARATION_NODE:
+    if (n->declaration.assignment_expr != NULL) {
+      n->declaration.assignment_expr = simplify_expression(n->declaration.assignment_expr);
+    }
+    break;
+  case ASSIGNMENT_NODE:
+    n->statement.assignment.expression = simplify_expression(n->statement.assignment.expression);
+    break;
+  case IF_STATEMENT_NODE:
+    n->statement.if_else_statement.condition =
+      simplify_expression(n->statement.if_else_statement.condition);
+    break;
+  default:
+    break;
+  }
+}
+
+int simplify_ast(node *ast) {
+  memset(rule_hits, 0, sizeof(rule_hits));
+  ast_visit(ast, simplify_preorder, NULL, NULL);
+
+  int total = 0;
+  for (int i = 0; i < NUM_RULES; i++) {
+    total += rule_hits[i];
+  }
+  if (dumpStats) {
+    fprintf(dumpFile, "algebraic simplification: %d rewrites\n", total);
+    for (int i = 0; i < NUM_RULES; i++) {
+      fprintf(dumpFile, "  %s: %d\n", rule_names[i], rule_hits[i]);
+    }
+  }
+  return total;
+}
@@ -0,0 +1,14 @@
+#ifndef _SIMPLIFY_H
+#define _SIMPLIFY_H
+
+#include "ast.h"
+
+// Apply algebraic identities to the expressions of the type checked AST
+// until none of them matches anymore. Returns the number of rewrites.
+int simplify_ast(node *ast);
+
+// Checks if the expressions a and b, which are part of the same expression,
+// always have the same value
+bool is_same_expression(node *a, node *b);
+
+#endif
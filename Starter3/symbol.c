@@ -2,20 +2,28 @@
 #include <stdio.h>
 
 #include "symbol.h"
+#include "timing.h"
+#include "probes.h"
 
-std::vector<std::map<std::string, symbol_info> > symbol_tables;
+std::vector<symbol_map, tracked_allocator<symbol_map, MEMORY_SYMBOLS> > symbol_tables;
+extern std::vector<unsigned int> scope_id_stack;
+
+void clear_symbol_tables(void) {
+  symbol_tables.clear();
+  scope_id_stack.clear();
+}
 
 void set_symbol_info(int scope_id, char *symbol_name, symbol_info sym_info) {
   // check if symbol was not previously declared in this scope and only overwrite
   // if it didn't exist already or if it was just a placeholder (TYPE_UNKNOWN)
-  std::map<std::string, symbol_info>::iterator iter = symbol_tables[scope_id].find(symbol_name);
+  symbol_map::iterator iter = symbol_tables[scope_id].find(symbol_name);
   if (iter == symbol_tables[scope_id].end() || iter->second.type == TYPE_UNKNOWN){
     sym_info.already_declared = false;
     symbol_tables[scope_id][symbol_name] = sym_info;
   }
 }
 
-void init_symbol_table(std::map<std::string, symbol_info> &symbol_table){
+void init_symbol_table(symbol_map &symbol_table){
   // Add pre defined variables to the symbol table
   // Create templates for different types
   symbol_info attribute;
@@ -59,25 +67,28 @@ void init_symbol_table(std::map<std::string, symbol_info> &symbol_table){
 
 symbol_info &get_symbol_info(const std::vector<unsigned int> &scope_id_stack, char *symbol_name) {
   std::vector<unsigned int>::const_reverse_iterator iter;
+  counters.symbol_lookups++;
 
   // Traverse the scope id stack backwards
   for (iter = scope_id_stack.rbegin(); iter != scope_id_stack.rend(); iter++) {
 
     // Look at the symbol table for each scope
-    std::map<std::string, symbol_info> &symbol_table = symbol_tables[*iter];
+    symbol_map &symbol_table = symbol_tables[*iter];
 
     // Search for the symbol in the table
-    std::map<std::string, symbol_info>::iterator symbol_iter = symbol_table.find(symbol_name);
+    symbol_map::iterator symbol_iter = symbol_table.find(symbol_name);
 
     // If the symbol was found, return it
     if (symbol_iter != symbol_table.end()) {
+      PROBE2(symbol__hit, symbol_name, (int) (iter - scope_id_stack.rbegin()));
       return symbol_iter->second;
     }
   }
 
   // If the symbol was not found, add a dummy symbol to the symbol table of the
   // current scope with TYPE_UNKNOWN and return it
-  std::map<std::string, symbol_info> &symbol_table = symbol_tables[scope_id_stack.back()];
+  PROBE2(symbol__miss, symbol_name, (int) scope_id_stack.size());
+  symbol_map &symbol_table = symbol_tables[scope_id_stack.back()];
 
   symbol_info dummy_symbol_info;
   dummy_symbol_info.type = TYPE_UNKNOWN;
@@ -6,6 +6,7 @@
 #include <map>
 
 #include "ast.h"
+#include "accounting.h"
 
 typedef struct {
   symbol_type type;
@@ -15,12 +16,18 @@ typedef struct {
   bool already_declared;
 } symbol_info;
 
+typedef std::map<std::string, symbol_info, std::less<std::string>,
+                 tracked_allocator<std::pair<const std::string, symbol_info>, MEMORY_SYMBOLS> > symbol_map;
+
 // The symbol tables for each scope, indexed by scope id
-extern std::vector<std::map<std::string, symbol_info> > symbol_tables;
+extern std::vector<symbol_map, tracked_allocator<symbol_map, MEMORY_SYMBOLS> > symbol_tables;
 
 void set_symbol_info(int scope_id, char *symbol_name, symbol_info sym_info);
 symbol_info &get_symbol_info(const std::vector<unsigned int> &scope_id_stack, char *symbol_name);
-void init_symbol_table(std::map<std::string, symbol_info> &symbol_table);
+void init_symbol_table(symbol_map &symbol_table);
+
+// Remove the symbol tables and the scopes of the last compilation
+void clear_symbol_tables(void);
 
 #endif
 
@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "target.h"
+#include "cost.h"
+#include "optimize.h"
+#include "passes.h"
+
+/****** TARGET LIMITS ******/
+/*
+ * Drivers reject programs that need more native resources than they have,
+ * or fall back to software. When the optimized program exceeds the limits
+ * it is rewritten with increasingly costly steps until it fits:
+ *
+ *   1. Constants are repacked so that every PARAM holds up to four
+ *      different values, instead of one PARAM per literal.
+ *   2. Starting over from the program before register packing, reads of
+ *      copies of constants and attributes read the original instead, and
+ *      the copies are removed, even the ones into variables.
+ *   3. In addition, values that are computed by a cheap instruction from
+ *      constants and attributes alone are computed again right before
+ *      every use after the first one, instead of being held in between.
+ *
+ * Steps 2 and 3 shorten live ranges so that register packing needs fewer
+ * TEMPs, at the cost of instructions in step 3. The first attempt that
+ * fits is kept; otherwise the attempt that exceeds the limits the least
+ * is reported.
+ */
+
+typedef struct {
+  const char *name;
+  int target_limits::*limit;
+  int program_cost::*used;
+} limit_info;
+
+static const limit_info limit_infos[] = {
+  { "instructions", &target_limits::instructions, &program_cost::instructions },
+  { "alu",          &target_limits::alu,          &program_cost::alu },
+  { "texture",      &target_limits::texture,      &program_cost::texture },
+  { "temps",        &target_limits::temps,        &program_cost::temps },
+  { "params",       &target_limits::params,       &program_cost::params },
+  { "attribs",      &target_limits::attribs,      &program_cost::attribs },
+};
+
+static const int NUM_LIMITS = sizeof(limit_infos) / sizeof(limit_infos[0]);
+
+// The minimum native limits of ARB_fragment_program
+static const target_limits arb_limits = { 72, 48, 24, 16, 24, 10 };
+
+bool parse_target_limits(const char *spec, target_limits &limits) {
+  for (int l = 0; l < NUM_LIMITS; l++) {
+    limits.*limit_infos[l].limit = -1;
+  }
+
+  std::string items(spec);
+  size_t start = 0;
+  while (start <= items.size()) {
+    size_t end = items.find(',', start);
+    if (end == std::string::npos) {
+      end = items.size();
+    }
+    std::string item = items.substr(start, end - start);
+    start = end + 1;
+
+    if (item == "arb") {
+      limits = arb_limits;
+      continue;
+    }
+    size_t equals = item.find('=');
+    if (equals == std::string::npos) {
+      return false;
+    }
+    std::string name = item.substr(0, equals);
+    const char *value = item.c_str() + equals + 1;
+    char *value_end;
+    long number = strtol(value, &value_end, 10);
+    if (*value == '\0' || *value_end != '\0' || number < 0) {
+      return false;
+    }
+
+    int l = 0;
+    while (l < NUM_LIMITS && name != limit_infos[l].name) {
+      l++;
+    }
+    if (l == NUM_LIMITS) {
+      return false;
+    }
+    limits.*limit_infos[l].limit = number;
+  }
+  return true;
+}
+
+// The total amount by which the program exceeds the limits
+static int count_excess(const program_cost &cost, const target_limits &limits) {
+  int excess = 0;
+  for (int l = 0; l < NUM_LIMITS; l++) {
+    int limit = limits.*limit_infos[l].limit;
+    int used = cost.*limit_infos[l].used;
+    if (limit >= 0 && used > limit) {
+      excess += used - limit;
+    }
+  }
+  return excess;
+}
+
+static bool is_read_only(const ir_register &reg) {
+  return reg.kind == REGISTER_CONSTANT || (reg.kind == REGISTER_BUILTIN && !reg.write_only);
+}
+
+// Step 1
+int repack_constants(ir_program &prog) {
+  ir_program original = prog;
+  int num_params = ir_cost(prog).params;
+
+  // The values that each source reads from a constant, largest sets first
+  // so that smaller ones can share their PARAMs
+  std::vector<std::pair<int, std::pair<int, int> > > reads;
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    const ir_instruction &instr = prog.instructions[i];
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      if (prog.registers[instr.src[k].reg].kind == REGISTER_CONSTANT) {
+        int count = 0;
+        unsigned char components = ir_source_components(instr, k);
+        for (int c = 0; c < 4; c++) {
+          count += (components >> c) & 1;
+        }
+        reads.push_back(std::make_pair(-count, std::make_pair(i, k)));
+      }
+    }
+  }
+  std::stable_sort(reads.begin(), reads.end());
+
+  std::vector<std::vector<float> > packed;
+  std::vector<std::pair<int, std::vector<int> > > placements;
+  for (size_t r = 0; r < reads.size(); r++) {
+    const ir_instruction &instr = prog.instructions[reads[r].second.first];
+    const ir_src &src = instr.src[reads[r].second.second];
+    const ir_register &reg = prog.registers[src.reg];
+    unsigned char components = ir_source_components(instr, reads[r].second.second);
+
+    std::vector<float> values;
+    for (int c = 0; c < 4; c++) {
+      if ((components & (1 << c)) &&
+          std::find(values.begin(), values.end(), reg.value[c]) == values.end()) {
+        values.push_back(reg.value[c]);
+      }
+    }
+
+    // The PARAM that already has the most of the values and room for the
+    // rest of them
+    size_t p = packed.size();
+    int best_missing = 5;
+    for (size_t q = 0; q < packed.size(); q++) {
+      int missing = 0;
+      for (size_t v = 0; v < values.size(); v++) {
+        missing += std::find(packed[q].begin(), packed[q].end(), values[v]) == packed[q].end();
+      }
+      if (packed[q].size() + missing <= 4 && missing < best_missing) {
+        p = q;
+        best_missing = missing;
+      }
+    }
+    if (p == packed.size()) {
+      packed.push_back(std::vector<float>());
+    }
+    for (size_t v = 0; v < values.size(); v++) {
+      if (std::find(packed[p].begin(), packed[p].end(), values[v]) == packed[p].end()) {
+        packed[p].push_back(values[v]);
+      }
+    }
+
+    // The lane of each component of the old constant
+    std::vector<int> lanes(4, 0);
+    for (int c = 0; c < 4; c++) {
+      if (components & (1 << c)) {
+        lanes[c] = std::find(packed[p].begin(), packed[p].end(), reg.value[c]) - packed[p].begin();
+      }
+    }
+    placements.push_back(std::make_pair(p, lanes));
+  }
+
+  std::vector<int> params;
+  for (size_t p = 0; p < packed.size(); p++) {
+    std::vector<float> &v = packed[p];
+    while (v.size() < 4) {
+      v.push_back(v[0]);
+    }
+    params.push_back(ir_constant(prog, v[0], v[1], v[2], v[3]));
+  }
+
+  for (size_t r = 0; r < reads.size(); r++) {
+    ir_instruction &instr = prog.instructions[reads[r].second.first];
+    ir_src &src = instr.src[reads[r].second.second];
+    unsigned char positions = ir_source_positions(instr);
+    const std::vector<int> &lanes = placements[r].second;
+    src.reg = params[placements[r].first];
+    for (int c = 0; c < 4; c++) {
+      if (positions & (1 << c)) {
+        src.swizzle[c] = lanes[src.swizzle[c]];
+      }
+    }
+  }
+
+  int saved = num_params - ir_cost(prog).params;
+  if (saved <= 0) {
+    prog = original;
+    return 0;
+  }
+  return saved;
+}
+
+// Step 2
+static void forward_read_only_copies(ir_program &prog) {
+  // The read-only register component that each register component is a
+  // copy of, if any
+  typedef struct {
+    int reg;
+    int component;
+    bool negate;
+  } copy_source;
+  std::vector<copy_source> copies(prog.registers.size() * 4);
+  for (size_t i = 0; i < copies.size(); i++) {
+    copies[i].reg = -1;
+  }
+
+  for (size_t i = 0; i < prog.instructions.size(); i++) {
+    ir_instruction &instr = prog.instructions[i];
+    unsigned char positions = ir_source_positions(instr);
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      ir_src &src = instr.src[k];
+      // Every component that the source reads must be a copy of the same
+      // register, with the same negation
+      int reg = -2;
+      bool negate = false;
+      for (int c = 0; c < 4; c++) {
+        if (positions & (1 << c)) {
+          const copy_source &copy = copies[src.reg * 4 + src.swizzle[c]];
+          if (reg == -2) {
+            reg = copy.reg;
+            negate = copy.negate;
+          } else if (copy.reg != reg || copy.negate != negate) {
+            reg = -1;
+          }
+        }
+      }
+      if (reg < 0) {
+        continue;
+      }
+      ir_src original = src;
+      src.reg = reg;
+      src.negate = original.negate != negate;
+      for (int c = 0; c < 4; c++) {
+        if (positions & (1 << c)) {
+          src.swizzle[c] = copies[original.reg * 4 + original.swizzle[c]].component;
+        }
+      }
+    }
+
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        copy_source &copy = copies[instr.dst.reg * 4 + c];
+        copy.reg = -1;
+        if (instr.op == IR_MOV && !instr.saturate && is_read_only(prog.registers[instr.src[0].reg])) {
+          copy.reg = instr.src[0].reg;
+          copy.component = instr.src[0].swizzle[c];
+          copy.negate = instr.src[0].negate;
+        }
+      }
+    }
+  }
+  dead_code_elimination(prog, false);
+}
+
+// Step 3
+static bool is_rematerializable(const ir_program &prog, const ir_instruction &instr) {
+  if (is_expensive_opcode(instr.op) || instr.op == IR_LIT) {
+    return false;
+  }
+  for (int k = 0; k < ir_num_sources(instr.op); k++) {
+    if (!is_read_only(prog.registers[instr.src[k].reg])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void rematerialize(ir_program &prog) {
+  int num_registers = prog.registers.size();
+  // The instruction that last wrote each register component, and the
+  // number of times the value it wrote has been read
+  std::vector<int> defs(num_registers * 4, -1);
+  std::map<int, int> uses;
+
+  ir_instruction_list instructions;
+  instructions.swap(prog.instructions);
+  for (size_t i = 0; i < instructions.size(); i++) {
+    ir_instruction instr = instructions[i];
+    unsigned char positions = ir_source_positions(instr);
+    for (int k = 0; k < ir_num_sources(instr.op); k++) {
+      ir_src &src = instr.src[k];
+      if (src.reg >= num_registers) {
+        continue;
+      }
+      int def = -2;
+      for (int c = 0; c < 4; c++) {
+        if (positions & (1 << c)) {
+          int d = defs[src.reg * 4 + src.swizzle[c]];
+          def = (def == -2 || def == d) ? d : -1;
+        }
+      }
+      if (def < 0 || !is_rematerializable(prog, instructions[def])) {
+        continue;
+      }
+      if (uses[def]++ == 0) {
+        continue;
+      }
+      // Compute the value again into a new temporary
+      ir_instruction copy = instructions[def];
+      copy.dst.reg = ir_temp(prog);
+      prog.instructions.push_back(copy);
+      src.reg = copy.dst.reg;
+    }
+
+    for (int c = 0; c < 4; c++) {
+      if (instr.dst.mask & (1 << c)) {
+        defs[instr.dst.reg * 4 + c] = i;
+      }
+    }
+    prog.instructions.push_back(instr);
+  }
+}
+
+static void report_limits(FILE *f, const program_cost &cost, const target_limits &limits) {
+  fprintf(f, "Program exceeds the target limits:\n");
+  for (int l = 0; l < NUM_LIMITS; l++) {
+    int limit = limits.*limit_infos[l].limit;
+    int used = cost.*limit_infos[l].used;
+    if (limit >= 0 && used > limit) {
+      fprintf(f, "  %s: %d used, limit %d, over by %d\n", limit_infos[l].name, used, limit, used - limit);
+    }
+  }
+}
+
+bool fit_target_limits(ir_program &prog, const ir_program &unpacked,
+                       const target_limits &limits, FILE *f) {
+  ir_program best = prog;
+  int best_excess = count_excess(ir_cost(prog), limits);
+
+  for (int step = 1; step <= 3 && best_excess > 0; step++) {
+    ir_program attempt;
+    if (step == 1) {
+      attempt = prog;
+    } else {
+      attempt = unpacked;
+      forward_read_only_copies(attempt);
+      if (step == 3) {
+        rematerialize(attempt);
+      }
+      if (is_pass_enabled("register-packing")) {
+        register_packing(attempt);
+      }
+      if (is_pass_enabled("vectorization")) {
+        vectorization(attempt);
+      }
+    }
+    if (limits.params >= 0 && ir_cost(attempt).params > limits.params) {
+      repack_constants(attempt);
+    }
+
+    int excess = count_excess(ir_cost(attempt), limits);
+    if (excess < best_excess) {
+      best = attempt;
+      best_excess = excess;
+    }
+  }
+
+  prog = best;
+  if (best_excess > 0) {
+    report_limits(f, ir_cost(prog), limits);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef _TARGET_H
+#define _TARGET_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+// The resources that a target can run a program with. A negative limit
+// means that the resource is unlimited
+typedef struct {
+  int instructions;
+  int alu;
+  int texture;
+  int temps;
+  int params;
+  int attribs;
+} target_limits;
+
+// Parse a comma separated list of limits such as "arb,temps=12". The
+// profile "arb" sets the minimum limits that every ARB_fragment_program
+// implementation supports, and name=value sets one limit. Returns false if
+// the list isn't valid
+bool parse_target_limits(const char *spec, target_limits &limits);
+
+// Pack the constants that the program reads into as few PARAMs as
+// possible, each holding up to four different values. Returns the number
+// of PARAMs that were saved
+int repack_constants(ir_program &prog);
+
+// Rewrite the program until it fits within the limits, starting over from
+// unpacked, the program before register packing, when that helps. Returns
+// false if it doesn't fit, after reporting by how much every exceeded
+// limit was exceeded to f
+bool fit_target_limits(ir_program &prog, const ir_program &unpacked,
+                       const target_limits &limits, FILE *f);
+
+#endif
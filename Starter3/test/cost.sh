@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Summarize the estimated cost of the code generated for a corpus of
+# shaders as JSON, so that it can be compared across compiler versions.
+#
+# Usage: ./cost.sh [shader or directory ...]
+# Without arguments, every test in this folder is compiled. Set COMPILER
+# to use another compiler binary.
+
+COMPILER=${COMPILER:-../compiler467}
+COST_FILE="cost.out"
+RESULTS_FILE="costs.out"
+
+if [[ $# -eq 0 ]]; then
+  set -- .
+fi
+SHADERS=$(find "$@" -type f \( -name '*.in' -o -name '*.frag' \) | sed -e 's/^\.\///' | sort)
+
+# One line per shader with its name and cost. Shaders that fail to compile
+# don't dump a cost
+> $RESULTS_FILE
+for SHADER in $SHADERS; do
+  rm -f $COST_FILE
+  $COMPILER -Dj -U $COST_FILE $SHADER > /dev/null 2>&1
+  if [[ -s $COST_FILE ]]; then
+    echo "$SHADER $(cat $COST_FILE)" >> $RESULTS_FILE
+  fi
+done
+
+awk -v total=$(echo $SHADERS | wc -w) '
+  {
+    file = $1
+    cost = substr($0, length(file) + 2)
+    shaders[++compiled] = sprintf("    {\"file\": \"%s\", \"cost\": %s}", file, cost)
+
+    # Add up every count, including the ones of each opcode
+    while (match(cost, /"[A-Za-z0-9]+": [0-9]+/)) {
+      split(substr(cost, RSTART, RLENGTH), pair, /": /)
+      key = substr(pair[1], 2)
+      if (!(key in sums)) {
+        keys[++num_keys] = key
+      }
+      sums[key] += pair[2]
+      cost = substr(cost, RSTART + RLENGTH)
+    }
+  }
+  END {
+    printf "{\n  \"shaders\": [\n"
+    for (i = 1; i <= compiled; i++) {
+      printf "%s%s\n", shaders[i], (i < compiled) ? "," : ""
+    }
+    printf "  ],\n  \"compiled\": %d,\n  \"failed\": %d,\n  \"total\": {", compiled, total - compiled
+    # Opcode names are upper case
+    separator = ""
+    for (i = 1; i <= num_keys; i++) {
+      if (keys[i] !~ /^[A-Z0-9]+$/) {
+        printf "%s\"%s\": %d", separator, keys[i], sums[keys[i]]
+        separator = ", "
+      }
+    }
+    printf "%s\"opcodes\": {", separator
+    separator = ""
+    for (i = 1; i <= num_keys; i++) {
+      if (keys[i] ~ /^[A-Z0-9]+$/) {
+        printf "%s\"%s\": %d", separator, keys[i], sums[keys[i]]
+        separator = ", "
+      }
+    }
+    printf "}}\n}\n"
+  }' $RESULTS_FILE
+
+rm -f $COST_FILE $RESULTS_FILE
@@ -2,6 +2,11 @@
 
 TEST_PROGRAM="../compiler467 -Ds"
 
+# Run the tests in parallel with the test runner when it is built
+if [[ -x ../tester467 ]]; then
+  exec ../tester467 -c "${TEST_PROGRAM#../compiler467 }" "$@"
+fi
+
 TEST_FILE="test.out"
 FAILURES_FILE="failures.out"
 
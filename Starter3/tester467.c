@@ -0,0 +1,370 @@
+/***********************************************************************
+ * tester467.c
+ *
+ * Runs the tests of a test folder the way its tester.sh does, but without
+ * starting the compiler for every test. Tests are handed out to one
+ * worker per processor, which compiles them by calling the compiler in
+ * its own process, one after another.
+ *
+ * The scanner and the parser that flex and bison generate keep their
+ * state in globals, so compilations can't run in threads of one process.
+ * Every worker is a process instead, and the compiler resets its global
+ * state before every compilation.
+ *
+ * Usage: tester467 [-j jobs] [-c options] [-o] [regex ...]
+ * The options are passed to the compiler for every test, -Ds by default.
+ * -o and the regular expressions are the same as for tester.sh.
+ **********************************************************************/
+#include <ftw.h>
+#include <poll.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "compiler467.h"
+
+#define FAILURES_FILE "failures.out"
+
+// What a worker sends back for every test
+typedef struct {
+  int test;
+  int failed;
+  int length;  // Of the failure text that follows
+} test_result;
+
+static std::vector<std::string> all_tests;
+
+/****** FINDING TESTS ******/
+/*
+ * The tests are found in the same order as by find, so that they run and
+ * fail in the same order as with tester.sh
+ */
+
+static int add_test(const char *path, const struct stat *, int type, FTW *) {
+  size_t length = strlen(path);
+  if (type == FTW_F && length > 3 && strcmp(path + length - 3, ".in") == 0) {
+    // Without the ./ in front and the .in at the end
+    std::string test(path, length - 3);
+    all_tests.push_back(test.compare(0, 2, "./") == 0 ? test.substr(2) : test);
+  }
+  return 0;
+}
+
+// The tests that match one of the regular expressions, for every one of
+// them in turn, like [[ $TEST =~ $REGEX_TEST.* ]]
+static std::vector<std::string> select_tests(const std::vector<std::string> &regexes) {
+  if (regexes.empty()) {
+    return all_tests;
+  }
+
+  std::vector<std::string> tests;
+  for (size_t r = 0; r < regexes.size(); r++) {
+    regex_t regex;
+    if (regcomp(&regex, (regexes[r] + ".*").c_str(), REG_EXTENDED | REG_NOSUB) != 0) {
+      fprintf(stderr, "Invalid regular expression %s ignored\n", regexes[r].c_str());
+      continue;
+    }
+    for (size_t t = 0; t < all_tests.size(); t++) {
+      if (regexec(&regex, all_tests[t].c_str(), 0, NULL, 0) == 0) {
+        tests.push_back(all_tests[t]);
+      }
+    }
+    regfree(&regex);
+  }
+  return tests;
+}
+
+/****** RUNNING TESTS ******/
+
+static std::string read_file(const char *name) {
+  std::string text;
+  FILE *f = fopen(name, "r");
+  if (f == NULL) {
+    return text;
+  }
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    text.append(buffer, length);
+  }
+  fclose(f);
+  return text;
+}
+
+static void write_file(const char *name, const std::string &text) {
+  FILE *f = fopen(name, "w");
+  if (f != NULL) {
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+  }
+}
+
+// Compile the test with its output going to the file like
+// "compiler467 options test.in >> file 2>&1", with standard output
+// buffered and standard error not, so that they end up interleaved the
+// same way. Returns what the compiler wrote
+static std::string compile_test(const std::string &test, const std::vector<std::string> &options,
+                                const char *output) {
+  if (truncate(output, 0) != 0 || freopen(output, "a", stdout) == NULL ||
+      freopen(output, "a", stderr) == NULL) {
+    _exit(2);
+  }
+  setvbuf(stderr, NULL, _IONBF, 0);
+
+  std::string input = test + ".in";
+  std::vector<char *> argv;
+  argv.push_back((char *) "compiler467");
+  for (size_t o = 0; o < options.size(); o++) {
+    argv.push_back((char *) options[o].c_str());
+  }
+  argv.push_back((char *) input.c_str());
+  argv.push_back(NULL);
+
+  compiler467(argv.size() - 1, argv.data());
+  fflush(stdout);
+  return read_file(output);
+}
+
+// The differences between the expected and the actual output, as
+// $(diff $TEST_OUT $TEST_FILE) gives them
+static std::string diff(const std::string &expected, const char *actual) {
+  std::string command = "diff '" + expected + "' '" + actual + "'";
+  std::string text;
+  FILE *f = popen(command.c_str(), "r");
+  if (f == NULL) {
+    return "diff failed";
+  }
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    text.append(buffer, length);
+  }
+  pclose(f);
+  while (!text.empty() && text[text.size() - 1] == '\n') {
+    text.erase(text.size() - 1);
+  }
+  return text;
+}
+
+// Run tests until there are none left, taking the next one from the
+// counter that all workers share, and send the results to the pipe. The
+// compiler writes to the output file
+static void work(const std::vector<std::string> &tests, const std::vector<std::string> &options,
+                 bool overwrite, int *next_test, int pipe, const char *output) {
+  int t;
+  while ((t = __atomic_fetch_add(next_test, 1, __ATOMIC_RELAXED)) < (int) tests.size()) {
+    std::string actual = compile_test(tests[t], options, output);
+    std::string expected_file = tests[t] + ".out";
+    if (overwrite || access(expected_file.c_str(), F_OK) != 0) {
+      write_file(expected_file.c_str(), overwrite ? actual : "");
+    }
+
+    test_result result = { t, 0, 0 };
+    std::string failure;
+    if (read_file(expected_file.c_str()) != actual) {
+      failure = diff(expected_file, output);
+      result.failed = 1;
+      result.length = failure.size();
+    }
+    if (write(pipe, &result, sizeof(result)) != sizeof(result) ||
+        write(pipe, failure.data(), failure.size()) != (ssize_t) failure.size()) {
+      break;
+    }
+  }
+}
+
+/****** COLLECTING RESULTS ******/
+
+typedef struct {
+  int fd;     // The pipe of its results, -1 once it has been closed
+  pid_t pid;  // -1 once it has exited
+  std::string output;
+  std::string data;
+} worker;
+
+// Start a worker on the tests that are left, which sends its results
+// through a new pipe. Its output file is made here, so that it can be
+// removed even if the worker crashes. Returns false if it couldn't be
+// started
+static bool start_worker(std::vector<worker> &workers, const std::vector<std::string> &tests,
+                         const std::vector<std::string> &options, bool overwrite,
+                         int *next_test) {
+  char output[] = ".tester467.XXXXXX";
+  int fd = mkstemp(output);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    unlink(output);
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    unlink(output);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    for (size_t w = 0; w < workers.size(); w++) {
+      if (workers[w].fd >= 0) {
+        close(workers[w].fd);
+      }
+    }
+    work(tests, options, overwrite, next_test, fds[1], output);
+    _exit(0);
+  }
+  close(fds[1]);
+  worker w = { fds[0], pid, output, "" };
+  workers.push_back(w);
+  return true;
+}
+
+// Take the complete results out of what the worker sent
+static void take_results(worker &w, std::vector<int> &status, std::vector<std::string> &failures) {
+  size_t start = 0;
+  while (w.data.size() - start >= sizeof(test_result)) {
+    test_result result;
+    memcpy(&result, w.data.data() + start, sizeof(result));
+    if (w.data.size() - start - sizeof(result) < (size_t) result.length) {
+      break;
+    }
+    status[result.test] = result.failed;
+    failures[result.test] = w.data.substr(start + sizeof(result), result.length);
+    start += sizeof(result) + result.length;
+  }
+  w.data.erase(0, start);
+}
+
+int main(int argc, char *argv[]) {
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  std::vector<std::string> options(1, "-Ds");
+  bool overwrite = false;
+
+  int i = 1;
+  for (; i + 1 < argc && (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-c") == 0); i += 2) {
+    if (argv[i][1] == 'j') {
+      jobs = atoi(argv[i + 1]);
+    } else {
+      options.clear();
+      char *option = strtok(argv[i + 1], " ");
+      for (; option != NULL; option = strtok(NULL, " ")) {
+        options.push_back(option);
+      }
+    }
+  }
+  if (i < argc && strcmp(argv[i], "-o") == 0) {
+    overwrite = true;
+    i++;
+  }
+  std::vector<std::string> regexes(argv + i, argv + argc);
+
+  nftw(".", add_test, 16, FTW_PHYS);
+  size_t name_length = 0;
+  for (size_t t = 0; t < all_tests.size(); t++) {
+    name_length = std::max(name_length, all_tests[t].size());
+  }
+  std::vector<std::string> tests = select_tests(regexes);
+
+  // Tests that never report back crashed the compiler, or never ran
+  std::vector<int> status(tests.size(), -1);
+  std::vector<std::string> failures(tests.size());
+
+  int *next_test = (int *) mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  *next_test = 0;
+  jobs = std::max(1, std::min(jobs, (int) tests.size()));
+  std::vector<worker> workers;
+  for (int j = 0; j < jobs && !tests.empty(); j++) {
+    if (!start_worker(workers, tests, options, overwrite, next_test)) {
+      break;
+    }
+  }
+
+  // A worker that the compiler crashes loses the test it was compiling,
+  // and is replaced by a new one if there are tests left
+  for (;;) {
+    std::vector<pollfd> polled;
+    std::vector<size_t> polled_workers;
+    for (size_t w = 0; w < workers.size(); w++) {
+      if (workers[w].fd >= 0) {
+        pollfd p = { workers[w].fd, POLLIN, 0 };
+        polled.push_back(p);
+        polled_workers.push_back(w);
+      }
+    }
+    if (polled.empty() || poll(polled.data(), polled.size(), -1) < 0) {
+      break;
+    }
+    for (size_t p = 0; p < polled.size(); p++) {
+      if (polled[p].revents == 0) {
+        continue;
+      }
+      worker &w = workers[polled_workers[p]];
+      char buffer[4096];
+      ssize_t length = read(w.fd, buffer, sizeof(buffer));
+      if (length > 0) {
+        w.data.append(buffer, length);
+        take_results(w, status, failures);
+        continue;
+      }
+
+      close(w.fd);
+      w.fd = -1;
+      int exit_status = 0;
+      waitpid(w.pid, &exit_status, 0);
+      w.pid = -1;
+      unlink(w.output.c_str());
+      if (WIFSIGNALED(exit_status) &&
+          __atomic_load_n(next_test, __ATOMIC_RELAXED) < (int) tests.size()) {
+        start_worker(workers, tests, options, overwrite, next_test);
+      }
+    }
+  }
+  for (size_t w = 0; w < workers.size(); w++) {
+    if (workers[w].pid >= 0) {
+      waitpid(workers[w].pid, NULL, 0);
+      unlink(workers[w].output.c_str());
+    }
+  }
+
+  // Report the failures and then every result, like tester.sh
+  FILE *failures_file = fopen(FAILURES_FILE, "w");
+  int failed = 0;
+  std::string results;
+  for (size_t t = 0; t < tests.size(); t++) {
+    if (status[t] == -1) {
+      failures[t] = (int) t < *next_test ? "compiler467 crashed" : "not run";
+    }
+    if (status[t] != 0) {
+      std::string report = "-------------\n" + tests[t] + "\n" + failures[t] + "\n-------------\n";
+      fputs(report.c_str(), stdout);
+      if (failures_file != NULL) {
+        fputs(report.c_str(), failures_file);
+      }
+      failed++;
+    }
+
+    char line[1024];
+    snprintf(line, sizeof(line), "%-*s : %s\n", (int) name_length, tests[t].c_str(),
+             status[t] == 0 ? "\033[32mPASS\033[39m" : "\033[31mFAIL\033[39m");
+    results += line;
+  }
+  if (failures_file != NULL) {
+    fclose(failures_file);
+  }
+  fputs(results.c_str(), stdout);
+
+  return failed;
+}
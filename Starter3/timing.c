@@ -0,0 +1,336 @@
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "timing.h"
+#include "common.h"
+#include "accounting.h"
+#include "probes.h"
+#include "hwcounters.h"
+
+/****** PHASE TIMING ******/
+/*
+ * The phases form a stack: beginning a phase charges the time since the
+ * last change to the phase below it, so every moment of the compilation
+ * is counted for exactly one phase. Wall time includes waiting for the
+ * input, CPU time only counts the time that the compiler ran for.
+ *
+ * Every phase also records the memory in use when it ended and the most
+ * that was in use while it ran, including the phases that it paused for.
+ * Scanning isn't on the stack, so the memory it allocates is parsing's.
+ *
+ * The counters are always kept since they are cheap, but the clocks are
+ * only read when the times are going to be reported, or when a tool is
+ * attached to the phase__end probe.
+ *
+ * The scanner runs for every token, where reading both clocks would cost
+ * more than scanning the token. It only reads the monotonic clock, which
+ * the vDSO reads without a system call, and its time is moved out of
+ * parsing when the times are reported. It fires no phase probes.
+ *
+ * With -Th the hardware counters are read at every phase change as well,
+ * and the difference, scaled by how long the counters ran in between, is
+ * charged the same way as the times. Reading them is a system call, so
+ * the scanner doesn't, and its counts are part of parsing. Without -Tt or
+ * -Tj the clocks aren't read at all.
+ */
+
+compile_counters counters;
+
+static const char *phase_names[NUM_PHASES] = {
+  "scanning",
+  "parsing",
+  "semantic",
+  "optimization",
+  "registers",
+  "codegen",
+  "output",
+  "cleanup",
+};
+
+static double wall_times[NUM_PHASES];
+static double cpu_times[NUM_PHASES];
+static long memory_bytes[NUM_PHASES];
+static long memory_peaks[NUM_PHASES];
+
+static compile_phase stack[NUM_PHASES];
+// The peak of the memory window of every paused phase
+static long paused_peaks[NUM_PHASES];
+// When every phase on the stack began, if the phase__end probe is attached
+static double start_times[NUM_PHASES];
+static int depth;
+static double last_wall;
+static double last_cpu;
+
+// When the token that is being scanned began, and the time of all tokens
+static double scan_start;
+static double scan_wall;
+
+static double hardware_counts[NUM_PHASES][NUM_HW_COUNTERS];
+static hardware_reading last_hardware[NUM_HW_COUNTERS];
+// Set if the kernel couldn't schedule the hardware counters at some point
+static bool hardware_failed;
+
+// Milliseconds on the given clock
+static double read_clock(clockid_t clock) {
+  timespec t;
+  clock_gettime(clock, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// Nanoseconds since the time on the monotonic clock, or 0 if the probe
+// was attached after the phase began
+static inline long nanoseconds_since(double start) {
+  return start == 0 ? 0 : (long) ((read_clock(CLOCK_MONOTONIC) - start) * 1e6);
+}
+
+// Charge the time since the last change to the running phase
+static void charge_time() {
+  if (traceTiming || traceTimingJSON) {
+    double wall = read_clock(CLOCK_MONOTONIC);
+    double cpu = read_clock(CLOCK_PROCESS_CPUTIME_ID);
+    if (depth > 0) {
+      wall_times[stack[depth - 1]] += wall - last_wall;
+      cpu_times[stack[depth - 1]] += cpu - last_cpu;
+    }
+    last_wall = wall;
+    last_cpu = cpu;
+  }
+
+  if (traceHardware) {
+    hardware_reading readings[NUM_HW_COUNTERS];
+    if (!read_hardware_counters(readings)) {
+      hardware_failed = true;
+    }
+    for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+      if (depth > 0) {
+        hardware_counts[stack[depth - 1]][c] +=
+            hardware_count_between(last_hardware[c], readings[c]);
+      }
+      last_hardware[c] = readings[c];
+    }
+  }
+}
+
+static bool is_timed() {
+  return traceTiming || traceTimingJSON || traceHardware;
+}
+
+void reset_phases(void) {
+  memset(&counters, 0, sizeof(counters));
+  for (int p = 0; p < NUM_PHASES; p++) {
+    wall_times[p] = 0;
+    cpu_times[p] = 0;
+    memory_bytes[p] = 0;
+    memory_peaks[p] = 0;
+    for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+      hardware_counts[p][c] = 0;
+    }
+  }
+  depth = 0;
+  scan_wall = 0;
+  hardware_failed = false;
+}
+
+void phase_begin(compile_phase phase) {
+  if (is_timed()) {
+    charge_time();
+    paused_peaks[depth] = memory_window_peak;
+    memory_window_peak = memory_total.bytes;
+  }
+  start_times[depth] = PROBE_ENABLED(phase__end) ? read_clock(CLOCK_MONOTONIC) : 0;
+  stack[depth++] = phase;
+  PROBE2(phase__begin, (int) phase, phase_names[phase]);
+}
+
+void phase_end(void) {
+  if (is_timed()) {
+    charge_time();
+  }
+  depth--;
+
+  compile_phase phase = stack[depth];
+  if (is_timed()) {
+    if (memory_window_peak > memory_peaks[phase]) {
+      memory_peaks[phase] = memory_window_peak;
+    }
+    memory_bytes[phase] = memory_total.bytes;
+    if (paused_peaks[depth] > memory_window_peak) {
+      memory_window_peak = paused_peaks[depth];
+    }
+  }
+  if (PROBE_ENABLED(phase__end)) {
+    PROBE3(phase__end, (int) phase, phase_names[phase], nanoseconds_since(start_times[depth]));
+  }
+}
+
+void scan_begin(void) {
+  if (traceTiming || traceTimingJSON) {
+    scan_start = read_clock(CLOCK_MONOTONIC);
+  }
+}
+
+void scan_end(void) {
+  if (traceTiming || traceTimingJSON) {
+    scan_wall += read_clock(CLOCK_MONOTONIC) - scan_start;
+  }
+}
+
+// Move the time of scanning out of parsing, which it was counted as
+static void split_scanning() {
+  double share = wall_times[PHASE_PARSING] > 0 ? scan_wall / wall_times[PHASE_PARSING] : 0;
+  wall_times[PHASE_SCANNING] = scan_wall;
+  cpu_times[PHASE_SCANNING] = cpu_times[PHASE_PARSING] * share;
+  wall_times[PHASE_PARSING] -= wall_times[PHASE_SCANNING];
+  cpu_times[PHASE_PARSING] -= cpu_times[PHASE_SCANNING];
+}
+
+/****** HARDWARE COUNTER REPORT ******/
+/*
+ * IPC is instructions per cycle, cache misses are given per thousand
+ * instructions and branch misses as a percentage of the branches. Counters
+ * that aren't available are shown as n/a, and ratios of nothing as -.
+ */
+
+static void print_count(FILE *f, int width, const double counts[], hardware_counter c) {
+  if (has_hardware_counter(c)) {
+    fprintf(f, " %*.0f", width, counts[c]);
+  } else {
+    fprintf(f, " %*s", width, "n/a");
+  }
+}
+
+static void print_ratio(FILE *f, int width, const double counts[], hardware_counter a,
+                        hardware_counter b, double scale) {
+  if (!has_hardware_counter(a) || !has_hardware_counter(b)) {
+    fprintf(f, " %*s", width, "n/a");
+  } else if (counts[b] == 0) {
+    fprintf(f, " %*s", width, "-");
+  } else {
+    fprintf(f, " %*.2f", width, counts[a] * scale / counts[b]);
+  }
+}
+
+static void print_hardware_row(FILE *f, const char *name, const double counts[]) {
+  fprintf(f, "%-14s", name);
+  print_count(f, 12, counts, HW_CYCLES);
+  print_count(f, 12, counts, HW_INSTRUCTIONS);
+  print_ratio(f, 6, counts, HW_INSTRUCTIONS, HW_CYCLES, 1);
+  print_ratio(f, 9, counts, HW_L1D_MISSES, HW_INSTRUCTIONS, 1000);
+  print_ratio(f, 9, counts, HW_LLC_MISSES, HW_INSTRUCTIONS, 1000);
+  print_ratio(f, 9, counts, HW_BRANCH_MISSES, HW_BRANCHES, 100);
+  fprintf(f, "\n");
+}
+
+static void print_hardware(FILE *f) {
+  if (hardware_failed) {
+    fprintf(f, "hardware counters: not scheduled by the kernel\n");
+    return;
+  }
+  fprintf(f, "%-14s %12s %12s %6s %9s %9s %9s\n", "phase", "cycles", "instructions",
+          "IPC", "L1D MPKI", "LLC MPKI", "branch %");
+  double total[NUM_HW_COUNTERS] = {};
+  for (int p = PHASE_PARSING; p < NUM_PHASES; p++) {
+    print_hardware_row(f, phase_names[p], hardware_counts[p]);
+    for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+      total[c] += hardware_counts[p][c];
+    }
+  }
+  print_hardware_row(f, "total", total);
+}
+
+static const char *hardware_keys[NUM_HW_COUNTERS] = {
+  "cycles",
+  "instructions",
+  "l1d_misses",
+  "llc_misses",
+  "branches",
+  "branch_misses",
+};
+
+// Counters that aren't available are null
+static void print_hardware_json(FILE *f) {
+  if (hardware_failed) {
+    fprintf(f, "null");
+    return;
+  }
+  fprintf(f, "{");
+  for (int p = PHASE_PARSING; p < NUM_PHASES; p++) {
+    fprintf(f, "%s\"%s\": {", p == PHASE_PARSING ? "" : ", ", phase_names[p]);
+    for (int c = 0; c < NUM_HW_COUNTERS; c++) {
+      fprintf(f, "%s\"%s\": ", c == 0 ? "" : ", ", hardware_keys[c]);
+      if (has_hardware_counter((hardware_counter) c)) {
+        fprintf(f, "%.0f", hardware_counts[p][c]);
+      } else {
+        fprintf(f, "null");
+      }
+    }
+    fprintf(f, "}");
+  }
+  fprintf(f, "}");
+}
+
+// The most memory that the process has had, in kilobytes. Unlike the
+// accounted memory it includes everything that was allocated with malloc,
+// the code and the stack
+static long peak_rss() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void report_phases(void) {
+  split_scanning();
+
+  double total_wall = 0;
+  double total_cpu = 0;
+  for (int p = 0; p < NUM_PHASES; p++) {
+    total_wall += wall_times[p];
+    total_cpu += cpu_times[p];
+  }
+
+  if (traceTiming) {
+    fprintf(traceFile, "%-14s %10s %10s %10s %10s\n", "phase", "wall ms", "CPU ms", "bytes", "peak");
+    for (int p = 0; p < NUM_PHASES; p++) {
+      fprintf(traceFile, "%-14s %10.3f %10.3f %10ld %10ld\n", phase_names[p],
+              wall_times[p], cpu_times[p], memory_bytes[p], memory_peaks[p]);
+    }
+    fprintf(traceFile, "%-14s %10.3f %10.3f %10ld %10ld\n", "total",
+            total_wall, total_cpu, memory_total.bytes, memory_total.peak);
+    fprintf(traceFile, "tokens: %d\n", counters.tokens);
+    fprintf(traceFile, "AST nodes: %d\n", counters.nodes);
+    fprintf(traceFile, "scopes: %d\n", counters.scopes);
+    fprintf(traceFile, "symbol lookups: %d\n", counters.symbol_lookups);
+    fprintf(traceFile, "instructions: %d emitted, %d after optimization\n",
+            counters.emitted_instructions, counters.instructions);
+    fprintf(traceFile, "TEMPs: %d\n", counters.temps);
+    fprintf(traceFile, "peak RSS: %ld KB\n", peak_rss());
+    print_memory(traceFile);
+  }
+
+  if (traceHardware) {
+    print_hardware(traceFile);
+  }
+
+  if (traceTimingJSON) {
+    fprintf(traceFile, "{\"phases\": {");
+    for (int p = 0; p < NUM_PHASES; p++) {
+      fprintf(traceFile, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"bytes\": %ld, \"peak\": %ld}",
+              p == 0 ? "" : ", ", phase_names[p], wall_times[p], cpu_times[p],
+              memory_bytes[p], memory_peaks[p]);
+    }
+    fprintf(traceFile, "}, \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}, "
+                       "\"tokens\": %d, \"nodes\": %d, \"scopes\": %d, \"symbol_lookups\": %d, "
+                       "\"emitted_instructions\": %d, \"instructions\": %d, \"temps\": %d, "
+                       "\"peak_rss_kb\": %ld, \"memory\": ",
+            total_wall, total_cpu, counters.tokens, counters.nodes, counters.scopes,
+            counters.symbol_lookups, counters.emitted_instructions, counters.instructions,
+            counters.temps, peak_rss());
+    print_memory_json(traceFile);
+    if (traceHardware) {
+      fprintf(traceFile, ", \"hardware\": ");
+      print_hardware_json(traceFile);
+    }
+    fprintf(traceFile, "}\n");
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef _TIMING_H
+#define _TIMING_H
+
+// The phases of a compilation. Scanning happens during parsing, and the
+// time spent scanning isn't counted as parsing time. It is timed with
+// scan_begin and scan_end instead of phase_begin and phase_end
+typedef enum {
+  PHASE_SCANNING,
+  PHASE_PARSING,
+  PHASE_SEMANTIC,
+  PHASE_OPTIMIZATION,
+  PHASE_REGISTERS,
+  PHASE_CODEGEN,
+  PHASE_OUTPUT,
+  PHASE_CLEANUP,
+  NUM_PHASES
+} compile_phase;
+
+typedef struct {
+  int tokens;
+  int nodes;
+  int scopes;
+  int symbol_lookups;
+  int emitted_instructions;
+  int instructions;
+  int temps;
+} compile_counters;
+
+extern compile_counters counters;
+
+// Forget the times and counters of the last compilation
+void reset_phases(void);
+
+// Start timing a phase, pausing the phase that is running until the
+// matching phase_end. A phase can run several times, its times add up.
+// They also fire the phase__begin and phase__end probes
+void phase_begin(compile_phase phase);
+void phase_end(void);
+
+// Time the scanner around every token. Only the wall clock is read, which
+// doesn't need a system call, and the CPU time of scanning is estimated
+// from its share of the wall time of parsing
+void scan_begin(void);
+void scan_end(void);
+
+// Print the time and memory used by every phase, the counters, the memory
+// used by every subsystem and the peak resident set size to traceFile, if
+// -Tt or -Tj was given
+void report_phases(void);
+
+#endif
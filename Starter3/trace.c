@@ -0,0 +1,136 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "trace.h"
+#include "common.h"
+
+/****** TRACE BUFFER ******/
+/*
+ * Writing a line of text for every token and every reduction costs far
+ * more than scanning and parsing them, so the trace points only record
+ * small binary events:
+ *   - a token records its id and the length and offset of its text,
+ *     which is copied into a separate ring of characters
+ *   - a reduction records the id of its rule, which maps to the rule's
+ *     text the first time the rule is reduced
+ *
+ * Both rings have a single writer, the compiler thread, and a single
+ * reader, the decoder, which only runs when a ring is full, before an
+ * error is reported and after parsing, so they need no locks. The decoder
+ * writes the same text as the trace options always have.
+ */
+
+typedef struct {
+  unsigned char kind;
+  unsigned short length; // Of the token text
+  int id;                // Token or rule
+  unsigned int text;     // Position of the token text in the text ring
+} trace_event;
+
+// Sizes of the rings, which must be powers of two
+static const unsigned NUM_EVENTS = 1 << 12;
+static const unsigned TEXT_SIZE = 1 << 15;
+
+static trace_event events[NUM_EVENTS];
+static char text[TEXT_SIZE];
+
+// Positions only ever grow, their remainders index the rings
+static unsigned event_head;
+static unsigned event_tail;
+static unsigned text_head;
+static unsigned text_tail;
+
+static std::vector<const char *> rules;
+
+unsigned trace_mask;
+
+// The events that were recorded before a crash show how far the compiler
+// got, so the fatal signals decode them before the default action. This
+// isn't async-signal-safe, but the process is about to die anyway
+static void flush_on_signal(int signal_number) {
+  trace_flush();
+  fflush(traceFile);
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+bool trace_start(void) {
+  static bool handlers_installed = false;
+  trace_mask = (traceScanner ? TRACE_TOKEN : 0) | (traceParser ? TRACE_RULE : 0);
+  if (trace_mask != 0 && !handlers_installed) {
+    static const int fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    for (size_t i = 0; i < sizeof fatal_signals / sizeof fatal_signals[0]; i++) {
+      signal(fatal_signals[i], flush_on_signal);
+    }
+    atexit(trace_flush);
+    handlers_installed = true;
+  }
+#ifdef NO_TRACE
+  return trace_mask == 0;
+#else
+  return true;
+#endif
+}
+
+void trace_flush(void) {
+  for (; event_tail != event_head; event_tail++) {
+    const trace_event &event = events[event_tail % NUM_EVENTS];
+    if (event.kind == TRACE_TOKEN) {
+      fprintf(traceFile, "TOKEN %3d : ", event.id);
+      unsigned start = event.text % TEXT_SIZE;
+      unsigned before_end = std::min((unsigned) event.length, TEXT_SIZE - start);
+      fwrite(text + start, 1, before_end, traceFile);
+      fwrite(text, 1, event.length - before_end, traceFile);
+      putc('\n', traceFile);
+    } else {
+      fputs(rules[event.id], traceFile);
+      putc('\n', traceFile);
+    }
+  }
+  text_tail = text_head;
+}
+
+// The next free event, after making room for it and length characters
+static trace_event &next_event(unsigned length) {
+  if (event_head - event_tail == NUM_EVENTS || text_head + length - text_tail > TEXT_SIZE) {
+    trace_flush();
+  }
+  return events[event_head++ % NUM_EVENTS];
+}
+
+void trace_token(int token, const char *token_text, int length) {
+  // Longer tokens are errors, and only their start is kept
+  if (length > (int) TEXT_SIZE) {
+    length = TEXT_SIZE;
+  }
+  trace_event &event = next_event(length);
+  event.kind = TRACE_TOKEN;
+  event.length = length;
+  event.id = token;
+  event.text = text_head;
+
+  unsigned start = text_head % TEXT_SIZE;
+  if (start + length <= TEXT_SIZE) {
+    memcpy(text + start, token_text, length);
+  } else {
+    memcpy(text + start, token_text, TEXT_SIZE - start);
+    memcpy(text, token_text + TEXT_SIZE - start, length - (TEXT_SIZE - start));
+  }
+  text_head += length;
+}
+
+void trace_rule(int rule) {
+  trace_event &event = next_event(0);
+  event.kind = TRACE_RULE;
+  event.length = 0;
+  event.id = rule;
+  event.text = 0;
+}
+
+int trace_rule_id(const char *rule) {
+  rules.push_back(rule);
+  return rules.size() - 1;
+}
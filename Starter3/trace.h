@@ -0,0 +1,43 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+// The kinds of events that the scanner and parser trace
+enum {
+  TRACE_TOKEN = 1 << 0,
+  TRACE_RULE  = 1 << 1,
+};
+
+// The kinds of events that are recorded, set from -Tn and -Tp
+extern unsigned trace_mask;
+
+// Trace points record events in a ring buffer, which is decoded into the
+// trace file when it fills up and by trace_flush. Building with NO_TRACE
+// defined removes them
+#ifdef NO_TRACE
+#define TRACE_TOKEN_EVENT(token, text, length)
+#define TRACE_RULE_EVENT(rule)
+#else
+#define TRACE_TOKEN_EVENT(token, text, length) \
+  { if (trace_mask & TRACE_TOKEN) trace_token(token, text, length); }
+#define TRACE_RULE_EVENT(rule) \
+  { if (trace_mask & TRACE_RULE) { static int id = trace_rule_id(rule); trace_rule(id); } }
+#endif
+
+// Choose the events to record from the trace options. Returns false if
+// some of them were requested but tracing was compiled out. The events
+// that are still recorded are also decoded at exit and when the compiler
+// is killed by a fatal signal
+bool trace_start(void);
+
+void trace_token(int token, const char *text, int length);
+void trace_rule(int rule);
+
+// The id of a grammar rule, given its text
+int trace_rule_id(const char *rule);
+
+// Decode the events that were recorded so far into the trace file. This
+// is also called before reporting an error, so that the error follows the
+// tokens and rules that led to it
+void trace_flush(void);
+
+#endif